@@ -0,0 +1,585 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * bench.c
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <ucontext.h>
+#include <sched.h>
+#include "system.h"
+#include "scheduler.h"
+
+/**
+ * Microbenchmarks of the scheduler, each next to the same work done with
+ * pthreads and with ucontext:
+ *
+ *   yield  : ping-pong between two threads, ns per switch
+ *   spawn  : create a thread, run it to its exit and reclaim it
+ *   preempt: how late a 1 ms sleeper wakes while a CPU hog runs, with the
+ *            hog preempted by signal or polling a safepoint ("poll")
+ *   scale  : switches and spawns per thread from 10 up to max threads,
+ *            with percentiles of switches sampled evenly across the run;
+ *            pthreads yield across all cores, where no one switch follows
+ *            a yield, so they get none
+ *
+ *   make bench && ./cs238-bench [yield|spawn|preempt|scale|all] [max]
+ *
+ * max defaults to SCALE_MAX; a million threads (max 1000000) take about
+ * 6 GB, mostly the touched pages of their stacks.
+ *
+ * Everything runs on a single worker so that the numbers measure the
+ * switch path, not the balancing between workers. Samples are taken into
+ * arrays allocated up front; user threads neither allocate nor print.
+ */
+
+#define OPS 100000
+#define PROBES 1000
+#define SCALE_MAX 100000
+#define SCALE_SWITCHES 1000000
+#define PTHREAD_SCALE_MAX 1000
+#define UC_SCALE_MAX 100000
+#define UC_SCALE_STACK (16 * 1024) /* _uc_yielder_() down to swapcontext() */
+#define QUANTUM_US 1000
+#define UC_STACK (64 * 1024)
+
+struct bench {
+        uint64_t* sample;
+        size_t n;
+        volatile int turn; /* pthread ping-pong */
+        volatile int stop;
+        volatile size_t done;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        ucontext_t main;
+        ucontext_t peer;
+        ucontext_t* ctx; /* scale, one per thread */
+        size_t cur; /* scale, index of the running context */
+        size_t rounds; /* scale, yields per thread */
+        size_t stride; /* scale, yields per sample */
+        size_t count; /* scale, yields so far */
+        size_t taken; /* scale, samples so far */
+        uint64_t mark; /* scale, when the sampled yield began */
+};
+
+static struct bench _b_;
+
+static uint64_t _now_(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int _cmp_(const void* a, const void* b) {
+        uint64_t x;
+        uint64_t y;
+
+        x = *(const uint64_t*)a;
+        y = *(const uint64_t*)b;
+        return (x > y) - (x < y);
+}
+
+static uint64_t _pct_(const uint64_t* v, size_t n, double p) {
+        size_t i;
+
+        i = (size_t)(p * (double)(n - 1));
+        return v[i];
+}
+
+/**
+ * prints one row: total / ops as ns/op, then the percentiles of the first
+ * n samples (none if n is 0)
+ */
+static void _report_(const char* name, const char* impl, size_t ops, uint64_t total, size_t n) {
+        printf("%-16s %-10s %8lu %9.1f",
+               name,
+               impl,
+               (unsigned long)ops,
+               ops ? (double)total / (double)ops : 0.0);
+        if (n) {
+                qsort(_b_.sample, n, sizeof (uint64_t), _cmp_);
+                printf(" %8lu %8lu %8lu %8lu %9lu\n",
+                       (unsigned long)_pct_(_b_.sample, n, 0.50),
+                       (unsigned long)_pct_(_b_.sample, n, 0.90),
+                       (unsigned long)_pct_(_b_.sample, n, 0.99),
+                       (unsigned long)_pct_(_b_.sample, n, 0.999),
+                       (unsigned long)_b_.sample[n - 1]);
+        } else {
+                printf(" %8s %8s %8s %8s %9s\n", "-", "-", "-", "-", "-");
+        }
+}
+
+static void _init_(uint64_t quantum_us, int preempt) {
+        struct scheduler_config config;
+
+        memset(&config, 0, sizeof (config));
+        config.workers = 1;
+        config.quantum_us = quantum_us;
+        config.policy = SCHEDULER_RR;
+        config.preempt = preempt;
+        scheduler_init(&config);
+}
+
+static void _spawn_(scheduler_fnc_t fnc, void* arg) {
+        struct job* job;
+
+        if (!(job = scheduler_create(fnc, arg))) {
+                EXIT("scheduler_create()");
+        }
+        scheduler_detach(job);
+}
+
+/* yield ping-pong ------------------------------------------------------ */
+
+static void _yield_timed_(void* arg) {
+        uint64_t t;
+        size_t i;
+
+        UNUSED(arg);
+        for (i=0; i<_b_.n; ++i) {
+                t = _now_();
+                scheduler_yield();
+                _b_.sample[i] = (_now_() - t) / 2;
+        }
+}
+
+static void _yield_peer_(void* arg) {
+        size_t i;
+
+        UNUSED(arg);
+        for (i=0; i<_b_.n; ++i) {
+                scheduler_yield();
+        }
+}
+
+static void* _pthread_pong_(void* arg) {
+        size_t i;
+
+        UNUSED(arg);
+        for (i=0; i<_b_.n; ++i) {
+                pthread_mutex_lock(&_b_.mutex);
+                while (1 != _b_.turn) {
+                        pthread_cond_wait(&_b_.cond, &_b_.mutex);
+                }
+                _b_.turn = 0;
+                pthread_cond_signal(&_b_.cond);
+                pthread_mutex_unlock(&_b_.mutex);
+        }
+        return NULL;
+}
+
+static void _uc_pong_(void) {
+        for (;;) {
+                swapcontext(&_b_.peer, &_b_.main);
+        }
+}
+
+static void _bench_yield_(void) {
+        pthread_t thread;
+        uint64_t t;
+        uint64_t s;
+        size_t i;
+        char* stack;
+
+        _b_.n = OPS;
+
+        _init_(0, SCHEDULER_PREEMPT_SIGNAL);
+        _spawn_(_yield_timed_, NULL);
+        _spawn_(_yield_peer_, NULL);
+        t = _now_();
+        scheduler_execute();
+        _report_("yield", "scheduler", 2 * OPS, _now_() - t, OPS);
+
+        _b_.turn = 0;
+        if (pthread_create(&thread, NULL, _pthread_pong_, NULL)) {
+                EXIT("pthread_create()");
+        }
+        t = _now_();
+        for (i=0; i<OPS; ++i) {
+                s = _now_();
+                pthread_mutex_lock(&_b_.mutex);
+                _b_.turn = 1;
+                pthread_cond_signal(&_b_.cond);
+                while (0 != _b_.turn) {
+                        pthread_cond_wait(&_b_.cond, &_b_.mutex);
+                }
+                pthread_mutex_unlock(&_b_.mutex);
+                _b_.sample[i] = (_now_() - s) / 2;
+        }
+        _report_("yield", "pthread", 2 * OPS, _now_() - t, OPS);
+        pthread_join(thread, NULL);
+
+        if (!(stack = (char*)malloc(UC_STACK))) {
+                EXIT("out of memory");
+        }
+        getcontext(&_b_.peer);
+        _b_.peer.uc_stack.ss_sp = stack;
+        _b_.peer.uc_stack.ss_size = UC_STACK;
+        _b_.peer.uc_link = NULL;
+        makecontext(&_b_.peer, _uc_pong_, 0);
+        t = _now_();
+        for (i=0; i<OPS; ++i) {
+                s = _now_();
+                swapcontext(&_b_.main, &_b_.peer);
+                _b_.sample[i] = (_now_() - s) / 2;
+        }
+        _report_("yield", "ucontext", 2 * OPS, _now_() - t, OPS);
+        free(stack);
+}
+
+/* spawn and exit ------------------------------------------------------- */
+
+static void _empty_(void* arg) {
+        UNUSED(arg);
+        _b_.done++;
+}
+
+/**
+ * each child is created and run to its exit before the next one; FIFO
+ * run queue order puts it ahead of the parent's yield
+ */
+static void _spawner_(void* arg) {
+        uint64_t t;
+        size_t i;
+
+        UNUSED(arg);
+        for (i=0; i<_b_.n; ++i) {
+                t = _now_();
+                _spawn_(_empty_, NULL);
+                while (_b_.done <= i) {
+                        scheduler_yield();
+                }
+                _b_.sample[i] = _now_() - t;
+        }
+}
+
+static void* _pthread_empty_(void* arg) {
+        UNUSED(arg);
+        return NULL;
+}
+
+static void _uc_empty_(void) {
+        _b_.done++;
+}
+
+static void _bench_spawn_(void) {
+        pthread_t thread;
+        ucontext_t uc;
+        uint64_t t;
+        uint64_t s;
+        size_t i;
+        char* stack;
+
+        _b_.n = OPS;
+        _b_.done = 0;
+
+        _init_(0, SCHEDULER_PREEMPT_SIGNAL);
+        _spawn_(_spawner_, NULL);
+        t = _now_();
+        scheduler_execute();
+        _report_("spawn", "scheduler", OPS, _now_() - t, OPS);
+
+        t = _now_();
+        for (i=0; i<OPS; ++i) {
+                s = _now_();
+                if (pthread_create(&thread, NULL, _pthread_empty_, NULL)) {
+                        EXIT("pthread_create()");
+                }
+                pthread_join(thread, NULL);
+                _b_.sample[i] = _now_() - s;
+        }
+        _report_("spawn", "pthread", OPS, _now_() - t, OPS);
+
+        t = _now_();
+        for (i=0; i<OPS; ++i) {
+                s = _now_();
+                if (!(stack = (char*)malloc(UC_STACK))) {
+                        EXIT("out of memory");
+                }
+                getcontext(&uc);
+                uc.uc_stack.ss_sp = stack;
+                uc.uc_stack.ss_size = UC_STACK;
+                uc.uc_link = &_b_.main;
+                makecontext(&uc, _uc_empty_, 0);
+                swapcontext(&_b_.main, &uc);
+                free(stack);
+                _b_.sample[i] = _now_() - s;
+        }
+        _report_("spawn", "ucontext", OPS, _now_() - t, OPS);
+}
+
+/* preemption latency --------------------------------------------------- */
+
+static void _hog_(void* arg) {
+        UNUSED(arg);
+        while (!_b_.stop) {
+        }
+}
+
+/**
+ * sleeps 1 ms at a time; the lateness of each wake-up is what the hog
+ * costs the sleeper
+ */
+static void _probe_(void* arg) {
+        uint64_t deadline;
+        size_t i;
+
+        UNUSED(arg);
+        for (i=0; i<_b_.n; ++i) {
+                deadline = _now_() + 1000000;
+                scheduler_sleep(1000);
+                _b_.sample[i] = _now_() - deadline;
+        }
+        _b_.stop = 1;
+}
+
+static void _hog_poll_(void* arg) {
+        UNUSED(arg);
+        while (!_b_.stop) {
+                scheduler_poll();
+        }
+}
+
+static void* _pthread_hog_(void* arg) {
+        _hog_(arg);
+        return NULL;
+}
+
+static void _bench_preempt_(void) {
+        struct timespec ts;
+        pthread_t thread;
+        uint64_t deadline;
+        uint64_t t;
+        size_t i;
+
+        _b_.n = PROBES;
+        _b_.stop = 0;
+
+        _init_(QUANTUM_US, SCHEDULER_PREEMPT_SIGNAL);
+        _spawn_(_hog_, NULL);
+        _spawn_(_probe_, NULL);
+        t = _now_();
+        scheduler_execute();
+        _report_("preempt", "scheduler", PROBES, _now_() - t, PROBES);
+
+        _b_.stop = 0;
+        _init_(QUANTUM_US, SCHEDULER_PREEMPT_POLL);
+        _spawn_(_hog_poll_, NULL);
+        _spawn_(_probe_, NULL);
+        t = _now_();
+        scheduler_execute();
+        _report_("preempt", "poll", PROBES, _now_() - t, PROBES);
+
+        _b_.stop = 0;
+        if (pthread_create(&thread, NULL, _pthread_hog_, NULL)) {
+                EXIT("pthread_create()");
+        }
+        t = _now_();
+        for (i=0; i<PROBES; ++i) {
+                deadline = _now_() + 1000000;
+                ts.tv_sec = 0;
+                ts.tv_nsec = 1000000;
+                nanosleep(&ts, NULL);
+                _b_.sample[i] = _now_() - deadline;
+        }
+        _b_.stop = 1;
+        _report_("preempt", "pthread", PROBES, _now_() - t, PROBES);
+        pthread_join(thread, NULL);
+
+        /* a cooperative hog is never interrupted */
+        printf("%-16s %-10s %8s\n", "preempt", "ucontext", "n/a");
+}
+
+/* scaling -------------------------------------------------------------- */
+
+/**
+ * samples the yield marked by the user thread that ran before, if any;
+ * with a single worker it is the switch just made
+ */
+static void _yielder_sample_(void) {
+        if (_b_.mark) {
+                if (_b_.taken < OPS) {
+                        _b_.sample[_b_.taken++] = _now_() - _b_.mark;
+                }
+                _b_.mark = 0;
+        }
+}
+
+static void _yielder_(void* arg) {
+        size_t i;
+
+        for (i=0; i<(size_t)arg; ++i) {
+                _yielder_sample_();
+                if (0 == (++_b_.count % _b_.stride)) {
+                        _b_.mark = _now_();
+                }
+                scheduler_yield();
+        }
+        _yielder_sample_();
+}
+
+static void* _pthread_yielder_(void* arg) {
+        size_t i;
+
+        for (i=0; i<(size_t)arg; ++i) {
+                sched_yield();
+        }
+        return NULL;
+}
+
+static void _uc_yielder_(void) {
+        ucontext_t* self;
+        size_t i;
+
+        self = &_b_.ctx[_b_.cur];
+        for (i=0; i<_b_.rounds; ++i) {
+                swapcontext(self, &_b_.main);
+        }
+}
+
+/**
+ * resets the sampling of a scale run of n threads yielding rounds times
+ */
+static void _scale_reset_(size_t n, size_t rounds) {
+        _b_.stride = (n * rounds) / OPS;
+        _b_.stride = _b_.stride ? _b_.stride : 1;
+        _b_.count = 0;
+        _b_.taken = 0;
+        _b_.mark = 0;
+}
+
+/**
+ * every context yields to main, which resumes them in turn, as the worker
+ * does with its user threads
+ */
+static void _bench_scale_uc_(const char* name, size_t n, size_t rounds) {
+        char* stack;
+        uint64_t t;
+        uint64_t s;
+        size_t i;
+        size_t r;
+
+        if (!(_b_.ctx = (ucontext_t*)malloc(n * sizeof (ucontext_t))) ||
+            !(stack = (char*)malloc(n * UC_SCALE_STACK))) {
+                EXIT("out of memory");
+        }
+        _scale_reset_(n, rounds);
+        _b_.rounds = rounds;
+        t = _now_();
+        for (i=0; i<n; ++i) {
+                getcontext(&_b_.ctx[i]);
+                _b_.ctx[i].uc_stack.ss_sp = stack + i * UC_SCALE_STACK;
+                _b_.ctx[i].uc_stack.ss_size = UC_SCALE_STACK;
+                _b_.ctx[i].uc_link = &_b_.main;
+                makecontext(&_b_.ctx[i], _uc_yielder_, 0);
+        }
+        for (r=0; r<=rounds; ++r) {
+                for (i=0; i<n; ++i) {
+                        _b_.cur = i;
+                        if (0 == (++_b_.count % _b_.stride)) {
+                                s = _now_();
+                                swapcontext(&_b_.main, &_b_.ctx[i]);
+                                if (_b_.taken < OPS) {
+                                        _b_.sample[_b_.taken++] = _now_() - s;
+                                }
+                        } else {
+                                swapcontext(&_b_.main, &_b_.ctx[i]);
+                        }
+                }
+        }
+        _report_(name, "ucontext", n * (rounds + 1), _now_() - t, _b_.taken);
+        free(stack);
+        free(_b_.ctx);
+}
+
+static void _bench_scale_(size_t max) {
+        pthread_t* thread;
+        uint64_t t;
+        size_t rounds;
+        size_t n;
+        size_t i;
+        char name[32];
+
+        for (n=10; n<=max; n*=10) {
+                rounds = SCALE_SWITCHES / n;
+                rounds = rounds ? rounds : 1;
+                sprintf(name, "scale %lu", (unsigned long)n);
+
+                _init_(0, SCHEDULER_PREEMPT_SIGNAL);
+                _scale_reset_(n, rounds);
+                t = _now_();
+                for (i=0; i<n; ++i) {
+                        _spawn_(_yielder_, (void*)rounds);
+                }
+                _report_(name, "spawn", n, _now_() - t, 0);
+                t = _now_();
+                scheduler_execute();
+                _report_(name, "scheduler", n * (rounds + 1), _now_() - t, _b_.taken);
+
+                if (n > UC_SCALE_MAX) {
+                        printf("%-16s %-10s %8s\n", name, "ucontext", "n/a");
+                } else {
+                        _bench_scale_uc_(name, n, rounds);
+                }
+
+                if (n > PTHREAD_SCALE_MAX) {
+                        printf("%-16s %-10s %8s\n", name, "pthread", "n/a");
+                        continue;
+                }
+                if (!(thread = (pthread_t*)malloc(n * sizeof (pthread_t)))) {
+                        EXIT("out of memory");
+                }
+                t = _now_();
+                for (i=0; i<n; ++i) {
+                        if (pthread_create(&thread[i], NULL, _pthread_yielder_, (void*)rounds)) {
+                                EXIT("pthread_create()");
+                        }
+                }
+                for (i=0; i<n; ++i) {
+                        pthread_join(thread[i], NULL);
+                }
+                _report_(name, "pthread", n * (rounds + 1), _now_() - t, 0);
+                free(thread);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        const char* which;
+        size_t max;
+
+        which = (1 < argc) ? argv[1] : "all";
+        max = (2 < argc) ? (size_t)strtoul(argv[2], NULL, 10) : SCALE_MAX;
+        if (!(_b_.sample = (uint64_t*)malloc(OPS * sizeof (uint64_t)))) {
+                TRACE("out of memory");
+                return -1;
+        }
+        pthread_mutex_init(&_b_.mutex, NULL);
+        pthread_cond_init(&_b_.cond, NULL);
+
+        printf("%-16s %-10s %8s %9s %8s %8s %8s %8s %9s\n",
+               "benchmark", "impl", "ops", "ns/op",
+               "p50", "p90", "p99", "p99.9", "max");
+        if (!strcmp(which, "yield") || !strcmp(which, "all")) {
+                _bench_yield_();
+        }
+        if (!strcmp(which, "spawn") || !strcmp(which, "all")) {
+                _bench_spawn_();
+        }
+        if (!strcmp(which, "preempt") || !strcmp(which, "all")) {
+                _bench_preempt_();
+        }
+        if (!strcmp(which, "scale") || !strcmp(which, "all")) {
+                _bench_scale_(max);
+        }
+
+        pthread_cond_destroy(&_b_.cond);
+        pthread_mutex_destroy(&_b_.mutex);
+        free(_b_.sample);
+        return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * cfs.c
+ */
+
+#include "rbtree.h"
+#include "policy.h"
+
+#define CFS_LATENCY 4 /* quanta in which every runnable job should run once */
+
+/**
+ * Completely fair scheduling. The worker charges each job's vruntime with
+ * the time it ran, scaled by SCHEDULER_WEIGHT / weight, at every switch;
+ * runnable jobs wait in a red-black tree ordered by vruntime and the
+ * leftmost one runs next, for a slice proportional to its share of the
+ * total weight. A job entering the tree, new, woken or migrated from
+ * another worker, has its vruntime clamped to within one latency period
+ * of the queue's min_vruntime, so it neither starves others nor is
+ * starved.
+ */
+
+struct cfs {
+        int lock;
+        size_t size;
+        uint64_t quantum;
+        uint64_t min_vruntime;
+        uint64_t weight; /* sum over the tree */
+        struct rbtree tree;
+};
+
+#define JOB(n) ((struct job*)((char*)(n) - offsetof(struct job, node)))
+
+static int cfs_less(const struct rbnode* a, const struct rbnode* b) {
+        return JOB(a)->vruntime < JOB(b)->vruntime;
+}
+
+static void* cfs_open(uint64_t quantum) {
+        struct cfs* cfs;
+
+        if (!(cfs = (struct cfs*)malloc(sizeof (struct cfs)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(cfs, 0, sizeof (struct cfs));
+        cfs->quantum = quantum;
+        rbtree_init(&cfs->tree);
+        return cfs;
+}
+
+static void cfs_close(void* rq) {
+        free(rq);
+}
+
+static void cfs_push(void* rq, struct job* job, int how, uint64_t now) {
+        struct cfs* cfs;
+        uint64_t latency;
+
+        UNUSED(now);
+        cfs = (struct cfs*)rq;
+        latency = CFS_LATENCY * cfs->quantum;
+
+        scheduler_lock(&cfs->lock);
+        if (POLICY_NEW == how) {
+                job->vruntime = cfs->min_vruntime;
+        } else if ((job->vruntime + latency) < cfs->min_vruntime) {
+                job->vruntime = cfs->min_vruntime - latency;
+        } else if (job->vruntime > (cfs->min_vruntime + latency)) {
+                job->vruntime = cfs->min_vruntime + latency;
+        }
+        rbtree_insert(&cfs->tree, &job->node, cfs_less);
+        cfs->weight += job->weight;
+        cfs->size++;
+        scheduler_unlock(&cfs->lock);
+}
+
+static struct job* cfs_take(struct cfs* cfs) {
+        struct rbnode* node;
+        struct job* job;
+        uint64_t slice;
+
+        if (NULL == (node = rbtree_first(&cfs->tree))) {
+                return NULL;
+        }
+        job = JOB(node);
+
+        /* the ideal slice is the job's share of one latency period */
+        slice = (CFS_LATENCY * cfs->quantum * job->weight) / cfs->weight;
+        job->slice = (slice < cfs->quantum) ? cfs->quantum : slice;
+
+        rbtree_remove(&cfs->tree, node);
+        cfs->weight -= job->weight;
+        cfs->size--;
+        if (job->vruntime > cfs->min_vruntime) {
+                cfs->min_vruntime = job->vruntime;
+        }
+        return job;
+}
+
+static struct job* cfs_pop(void* rq, uint64_t now) {
+        struct cfs* cfs;
+        struct job* job;
+
+        UNUSED(now);
+        cfs = (struct cfs*)rq;
+        scheduler_lock(&cfs->lock);
+        job = cfs_take(cfs);
+        scheduler_unlock(&cfs->lock);
+        return job;
+}
+
+static struct job* cfs_steal(void* rq, uint64_t now) {
+        if (!__atomic_load_n(&((struct cfs*)rq)->size, __ATOMIC_RELAXED)) {
+                return NULL;
+        }
+        return cfs_pop(rq, now);
+}
+
+static size_t cfs_size(void* rq) {
+        return __atomic_load_n(&((struct cfs*)rq)->size, __ATOMIC_RELAXED);
+}
+
+const struct policy policy_cfs = {
+        "cfs",
+        cfs_open,
+        cfs_close,
+        cfs_push,
+        cfs_pop,
+        cfs_steal,
+        cfs_size,
+        0
+};
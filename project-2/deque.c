@@ -0,0 +1,191 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * deque.c
+ */
+
+#include "deque.h"
+
+#define CACHE_LINE 64
+
+/**
+ * Chase-Lev dynamic circular work-stealing deque, using the memory
+ * orderings of Le et al., "Correct and Efficient Work-Stealing for Weak
+ * Memory Models" (PPoPP 2013).
+ *
+ * A ring that was outgrown cannot be freed right away because a thief may
+ * still be reading a slot from it, so it is retired onto a list owned by
+ * the new ring and released in deque_close().
+ */
+
+struct ring {
+        int64_t mask; /* number of slots - 1 */
+        struct job** slot;
+        struct ring* retired;
+};
+
+struct deque {
+        int64_t top;
+        char pad0[CACHE_LINE - sizeof (int64_t)];
+        int64_t bottom;
+        char pad1[CACHE_LINE - sizeof (int64_t)];
+        struct ring* ring;
+};
+
+static struct ring* ring_open(int64_t n) {
+        struct ring* ring;
+
+        if (!(ring = (struct ring*)malloc(sizeof (struct ring)))) {
+                return NULL;
+        }
+        if (!(ring->slot = (struct job**)malloc((size_t)n * sizeof (struct job*)))) {
+                free(ring);
+                return NULL;
+        }
+        ring->mask = n - 1;
+        ring->retired = NULL;
+        return ring;
+}
+
+static struct ring* ring_grow(struct deque* deque, struct ring* ring, int64_t t, int64_t b) {
+        struct ring* bigger;
+        int64_t i;
+
+        if (!(bigger = ring_open(2 * (ring->mask + 1)))) {
+                EXIT("out of memory");
+                return NULL;
+        }
+        for (i=t; i<b; ++i) {
+                bigger->slot[i & bigger->mask] = ring->slot[i & ring->mask];
+        }
+        bigger->retired = ring;
+        __atomic_store_n(&deque->ring, bigger, __ATOMIC_RELEASE);
+        return bigger;
+}
+
+struct deque *deque_open(size_t capacity) {
+        struct deque* deque;
+        int64_t n;
+
+        n = 2;
+        while ((size_t)n < capacity) {
+                n *= 2;
+        }
+        if (!(deque = (struct deque*)malloc(sizeof (struct deque)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        if (!(deque->ring = ring_open(n))) {
+                TRACE("out of memory");
+                free(deque);
+                return NULL;
+        }
+        deque->top = 0;
+        deque->bottom = 0;
+        return deque;
+}
+
+void deque_close(struct deque *deque) {
+        struct ring* ring;
+        struct ring* next;
+
+        if (deque) {
+                ring = deque->ring;
+                while (ring) {
+                        next = ring->retired;
+                        free(ring->slot);
+                        free(ring);
+                        ring = next;
+                }
+                free(deque);
+        }
+}
+
+void deque_push(struct deque *deque, struct job *job) {
+        struct ring* ring;
+        int64_t b;
+        int64_t t;
+
+        b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+        t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+        ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+        if ((b - t) > ring->mask) {
+                ring = ring_grow(deque, ring, t, b);
+        }
+        __atomic_store_n(&ring->slot[b & ring->mask], job, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+struct job *deque_pop(struct deque *deque) {
+        struct ring* ring;
+        struct job* job;
+        int64_t b;
+        int64_t t;
+
+        b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+        ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+        if (t > b) {
+                /* empty */
+                __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+                return NULL;
+        }
+
+        job = __atomic_load_n(&ring->slot[b & ring->mask], __ATOMIC_RELAXED);
+        if (t == b) {
+                /* last job, race the thieves for it */
+                if (!__atomic_compare_exchange_n(&deque->top,
+                                                 &t,
+                                                 t + 1,
+                                                 0,
+                                                 __ATOMIC_SEQ_CST,
+                                                 __ATOMIC_RELAXED)) {
+                        job = NULL;
+                }
+                __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+        return job;
+}
+
+struct job *deque_steal(struct deque *deque) {
+        struct ring* ring;
+        struct job* job;
+        int64_t b;
+        int64_t t;
+
+        t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+        if (t >= b) {
+                return NULL;
+        }
+
+        ring = __atomic_load_n(&deque->ring, __ATOMIC_ACQUIRE);
+        job = __atomic_load_n(&ring->slot[t & ring->mask], __ATOMIC_RELAXED);
+        if (!__atomic_compare_exchange_n(&deque->top,
+                                         &t,
+                                         t + 1,
+                                         0,
+                                         __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+                return NULL;
+        }
+        return job;
+}
+
+size_t deque_size(const struct deque *deque) {
+        int64_t b;
+        int64_t t;
+
+        b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+        t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+        return (b > t) ? (size_t)(b - t) : 0;
+}
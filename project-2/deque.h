@@ -0,0 +1,68 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * deque.h
+ */
+
+#ifndef _DEQUE_H_
+#define _DEQUE_H_
+
+#include "system.h"
+
+struct job;
+struct deque;
+
+/**
+ * Creates an empty Chase-Lev work-stealing deque of jobs. One thread, the
+ * owner, may push and pop at the bottom; any thread may steal from the top.
+ *
+ * capacity: the initial number of slots, rounded up to a power of two; the
+ *           deque grows on demand
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct deque *deque_open(size_t capacity);
+
+/**
+ * Destroys a deque previously obtained by calling deque_open(). No other
+ * thread may be accessing the deque.
+ *
+ * Note: deque may be NULL
+ */
+
+void deque_close(struct deque *deque);
+
+/**
+ * Pushes job at the bottom of the deque. Owner only.
+ */
+
+void deque_push(struct deque *deque, struct job *job);
+
+/**
+ * Pops the most recently pushed job from the bottom of the deque. Owner only.
+ *
+ * return: a job or NULL if the deque is empty
+ */
+
+struct job *deque_pop(struct deque *deque);
+
+/**
+ * Steals the oldest job from the top of the deque. Safe to call from any
+ * thread, including the owner.
+ *
+ * return: a job or NULL if the deque is empty or the race was lost
+ */
+
+struct job *deque_steal(struct deque *deque);
+
+/**
+ * Returns a racy estimate of the number of jobs in the deque.
+ */
+
+size_t deque_size(const struct deque *deque);
+
+#endif /* _DEQUE_H_ */
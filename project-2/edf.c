@@ -0,0 +1,102 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * edf.c
+ */
+
+#include "heap.h"
+#include "policy.h"
+
+/**
+ * Earliest deadline first. Released periodic jobs wait in a min-heap keyed
+ * by their absolute deadline, the end of the current period, and always
+ * run before aperiodic jobs, which are served FIFO in the background.
+ * A periodic job runs for at most its budget before it is preempted.
+ */
+
+struct edf {
+        int lock;
+        size_t size;
+        struct heap* periodic;
+        struct scheduler_queue background;
+};
+
+static void* edf_open(uint64_t quantum) {
+        struct edf* edf;
+
+        UNUSED(quantum);
+        if (!(edf = (struct edf*)malloc(sizeof (struct edf)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(edf, 0, sizeof (struct edf));
+        if (!(edf->periodic = heap_open())) {
+                free(edf);
+                return NULL;
+        }
+        return edf;
+}
+
+static void edf_close(void* rq) {
+        if (rq) {
+                heap_close(((struct edf*)rq)->periodic);
+                free(rq);
+        }
+}
+
+static void edf_push(void* rq, struct job* job, int how, uint64_t now) {
+        struct edf* edf;
+
+        UNUSED(how);
+        UNUSED(now);
+        edf = (struct edf*)rq;
+        scheduler_lock(&edf->lock);
+        if (!job->period ||
+            heap_push(edf->periodic, job->release + job->period, job)) {
+                scheduler_queue_push(&edf->background, job);
+        }
+        edf->size++;
+        scheduler_unlock(&edf->lock);
+}
+
+static struct job* edf_pop(void* rq, uint64_t now) {
+        struct edf* edf;
+        struct job* job;
+
+        UNUSED(now);
+        edf = (struct edf*)rq;
+        scheduler_lock(&edf->lock);
+        if (NULL == (job = heap_pop(edf->periodic))) {
+                job = scheduler_queue_pop(&edf->background);
+        }
+        if (job) {
+                edf->size--;
+        }
+        scheduler_unlock(&edf->lock);
+        return job;
+}
+
+static struct job* edf_steal(void* rq, uint64_t now) {
+        if (!__atomic_load_n(&((struct edf*)rq)->size, __ATOMIC_RELAXED)) {
+                return NULL;
+        }
+        return edf_pop(rq, now);
+}
+
+static size_t edf_size(void* rq) {
+        return __atomic_load_n(&((struct edf*)rq)->size, __ATOMIC_RELAXED);
+}
+
+const struct policy policy_edf = {
+        "edf",
+        edf_open,
+        edf_close,
+        edf_push,
+        edf_pop,
+        edf_steal,
+        edf_size,
+        0
+};
@@ -0,0 +1,177 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * future.c
+ */
+
+#include "future.h"
+
+struct scheduler_future {
+        int lock;
+        int refs;
+        int ready;
+        void* value;
+        struct scheduler_queue waiters;
+        struct then* thens; /* continuations waiting for the value */
+};
+
+struct then {
+        scheduler_then_fnc_t fnc;
+        void* arg;
+        void* value; /* of the future it was attached to */
+        struct scheduler_future* source; /* held while pending, else NULL */
+        struct scheduler_future* result;
+        struct then* next;
+};
+
+static void future_put(struct scheduler_future* future) {
+        if (0 == __atomic_sub_fetch(&future->refs, 1, __ATOMIC_ACQ_REL)) {
+                assert( !future->waiters.head && !future->thens );
+                scheduler_free(future);
+        }
+}
+
+static void future_entry(void* arg) {
+        struct then* then;
+
+        then = (struct then*)arg;
+        scheduler_future_set(then->result, then->fnc(then->value, then->arg));
+        future_put(then->result);
+        if (then->source) {
+                future_put(then->source);
+        }
+        scheduler_free(then);
+}
+
+/**
+ * starts the continuation then as a new user thread; if that fails it
+ * runs on the calling thread instead
+ */
+static void future_start(struct then* then) {
+        struct job* job;
+
+        if (!(job = scheduler_create(future_entry, then))) {
+                future_entry(then);
+                return;
+        }
+        scheduler_detach(job);
+}
+
+struct scheduler_future *scheduler_future_open(void) {
+        struct scheduler_future* future;
+
+        if (!(future = (struct scheduler_future*)scheduler_malloc(sizeof (struct scheduler_future)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(future, 0, sizeof (struct scheduler_future));
+        future->refs = 1;
+        return future;
+}
+
+void scheduler_future_close(struct scheduler_future *future) {
+        if (future) {
+                future_put(future);
+        }
+}
+
+int scheduler_future_set(struct scheduler_future *future, void *value) {
+        struct scheduler_queue waiters;
+        struct then* thens;
+        struct then* order;
+        struct then* then;
+        struct job* j;
+
+        scheduler_lock(&future->lock);
+        if (future->ready) {
+                scheduler_unlock(&future->lock);
+                return -1;
+        }
+        future->value = value;
+        __atomic_store_n(&future->ready, 1, __ATOMIC_RELEASE);
+        waiters.head = NULL;
+        waiters.tail = NULL;
+        while (NULL != (j = scheduler_queue_pop(&future->waiters))) {
+                scheduler_queue_push(&waiters, j);
+        }
+        thens = future->thens;
+        future->thens = NULL;
+        scheduler_unlock(&future->lock);
+
+        while (NULL != (j = scheduler_queue_pop(&waiters))) {
+                scheduler_unpark(j);
+        }
+        /* thens was built newest first, start them in the order attached */
+        order = NULL;
+        while (thens) {
+                then = thens;
+                thens = then->next;
+                then->next = order;
+                order = then;
+        }
+        while (order) {
+                then = order;
+                order = then->next;
+                then->value = value;
+                future_start(then);
+        }
+        return 0;
+}
+
+void *scheduler_future_get(struct scheduler_future *future) {
+        if (scheduler_future_ready(future)) {
+                return future->value;
+        }
+        scheduler_testcancel();
+        scheduler_lock(&future->lock);
+        if (!future->ready) {
+                scheduler_queue_push(&future->waiters, scheduler_self());
+                if (scheduler_park_cancellable(&future->lock)) {
+                        scheduler_testcancel();
+                }
+        } else {
+                scheduler_unlock(&future->lock);
+        }
+        return future->value;
+}
+
+int scheduler_future_ready(struct scheduler_future *future) {
+        return __atomic_load_n(&future->ready, __ATOMIC_ACQUIRE);
+}
+
+struct scheduler_future *scheduler_future_then(struct scheduler_future *future,
+                                               scheduler_then_fnc_t fnc,
+                                               void *arg) {
+        struct then* then;
+
+        if (!(then = (struct then*)scheduler_malloc(sizeof (struct then)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        if (!(then->result = scheduler_future_open())) {
+                scheduler_free(then);
+                return NULL;
+        }
+        then->fnc = fnc;
+        then->arg = arg;
+        then->source = NULL;
+        then->result->refs = 2; /* the caller and the continuation */
+
+        scheduler_lock(&future->lock);
+        if (!future->ready) {
+                /* future may be closed before it is set, keep it for then */
+                __atomic_add_fetch(&future->refs, 1, __ATOMIC_RELAXED);
+                then->source = future;
+                then->next = future->thens;
+                future->thens = then;
+                scheduler_unlock(&future->lock);
+                return then->result;
+        }
+        scheduler_unlock(&future->lock);
+        then->value = future->value;
+        future_start(then);
+        return then->result;
+}
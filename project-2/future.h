@@ -0,0 +1,88 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * future.h
+ */
+
+#ifndef _FUTURE_H_
+#define _FUTURE_H_
+
+#include "scheduler.h"
+
+/**
+ * Futures: a value that is set once and read any number of times. A user
+ * thread may park until the value is set, or attach a continuation that
+ * runs as a new user thread once it is, so a chain of dependent steps
+ * holds no parked thread while it waits, only a future and the pending
+ * continuations.
+ *
+ * A future is reference counted: the handle returned by open() or then()
+ * is one reference, and a pending continuation holds one on the future it
+ * will set and one on the future it is attached to, so either handle may
+ * be closed while the continuation is pending.
+ */
+
+struct scheduler_future;
+
+/**
+ * scheduler_then_fnc_t defines the signature of a continuation; it gets
+ * the value of the future it was attached to and returns the value of the
+ * future then() returned.
+ */
+
+typedef void *(*scheduler_then_fnc_t)(void *value, void *arg);
+
+/**
+ * Creates a future whose value is not yet set.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct scheduler_future *scheduler_future_open(void);
+
+/**
+ * Releases a handle; the future goes once no continuation needs it.
+ *
+ * Note: future may be NULL
+ */
+
+void scheduler_future_close(struct scheduler_future *future);
+
+/**
+ * Sets the value of future, waking the user threads waiting for it and
+ * starting its continuations.
+ *
+ * return: 0 on success, -1 if the value was already set
+ */
+
+int scheduler_future_set(struct scheduler_future *future, void *value);
+
+/**
+ * Returns the value of future, parking the calling user thread until it is
+ * set. It is a cancellation point when it has to wait.
+ */
+
+void *scheduler_future_get(struct scheduler_future *future);
+
+/**
+ * return: 1 if the value of future is set, 0 otherwise
+ */
+
+int scheduler_future_ready(struct scheduler_future *future);
+
+/**
+ * Attaches a continuation to future: once its value is set, fnc(value,
+ * arg) runs in a new user thread and sets the returned future to its
+ * result.
+ *
+ * return: a new future, to be closed by the caller, or NULL on error
+ */
+
+struct scheduler_future *scheduler_future_then(struct scheduler_future *future,
+                                               scheduler_then_fnc_t fnc,
+                                               void *arg);
+
+#endif /* _FUTURE_H_ */
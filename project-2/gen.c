@@ -0,0 +1,110 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * gen.c
+ */
+
+#undef _FORTIFY_SOURCE
+
+#include <setjmp.h>
+#include "scheduler.h"
+#include "gen.h"
+
+#define GEN_STACK_PAGES 3
+
+enum { GEN_NEW, GEN_SUSPENDED, GEN_RUNNING, GEN_DONE };
+
+struct gen {
+        jmp_buf env; /* the producer, suspended in gen_yield() */
+        jmp_buf caller; /* the consumer, inside gen_next() */
+        void* start_addr;
+        void* stack_addr;
+        gen_fnc_t fnc;
+        void* arg;
+        void* value;
+        int state;
+};
+
+/**
+ * the first frame on the generator's stack; gen arrives in rdi since no
+ * thread-local variable survives a preempted consumer moving to another
+ * worker
+ */
+static void gen_entry(struct gen* gen) {
+        gen->fnc(gen, gen->arg);
+        gen->state = GEN_DONE;
+        longjmp(gen->caller, 1);
+}
+
+struct gen *gen_open(gen_fnc_t fnc, void *arg) {
+        size_t page_size_v;
+        struct gen* gen;
+
+        page_size_v = page_size();
+        if (!(gen = (struct gen*)scheduler_malloc(sizeof (struct gen)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        if (!(gen->start_addr = scheduler_malloc((GEN_STACK_PAGES + 1) * page_size_v))) {
+                TRACE("out of memory");
+                scheduler_free(gen);
+                return NULL;
+        }
+        gen->stack_addr = memory_align(gen->start_addr, page_size_v);
+        gen->stack_addr = (void*)((size_t)gen->stack_addr + GEN_STACK_PAGES * page_size_v);
+        gen->fnc = fnc;
+        gen->arg = arg;
+        gen->value = NULL;
+        gen->state = GEN_NEW;
+        return gen;
+}
+
+void gen_close(struct gen *gen) {
+        if (gen) {
+                scheduler_free(gen->start_addr);
+                scheduler_free(gen);
+        }
+}
+
+int gen_next(struct gen *gen, void **value) {
+        uint64_t rsp;
+
+        assert( GEN_RUNNING != gen->state );
+
+        if (GEN_DONE == gen->state) {
+                return 0;
+        }
+        if (0 == setjmp(gen->caller)) {
+                if (GEN_NEW == gen->state) {
+                        gen->state = GEN_RUNNING;
+                        rsp = (uint64_t)gen->stack_addr;
+                        __asm__ volatile ("mov %[rs], %%rsp \n"
+                                          "call *%[fn] \n"
+                                          :
+                                          : [rs] "r" (rsp), [fn] "r" (gen_entry), "D" (gen)
+                                          : "memory");
+                }
+                gen->state = GEN_RUNNING;
+                longjmp(gen->env, 1);
+        }
+        if (GEN_DONE == gen->state) {
+                return 0;
+        }
+        if (value) {
+                *value = gen->value;
+        }
+        return 1;
+}
+
+void gen_yield(struct gen *gen, void *value) {
+        assert( GEN_RUNNING == gen->state );
+
+        gen->value = value;
+        gen->state = GEN_SUSPENDED;
+        if (0 == setjmp(gen->env)) {
+                longjmp(gen->caller, 1);
+        }
+}
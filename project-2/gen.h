@@ -0,0 +1,75 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * gen.h
+ */
+
+#ifndef _GEN_H_
+#define _GEN_H_
+
+#include "system.h"
+
+/**
+ * Generators: stackful coroutines that hand values to their consumer. The
+ * producer runs on its own stack, but only while the consumer is inside
+ * gen_next(), and it is resumed directly with longjmp() instead of through
+ * a run queue. A generator therefore runs as part of whichever thread
+ * calls gen_next(); inside a user thread it is preempted, sleeps and
+ * blocks along with that thread.
+ *
+ * A producer may itself consume other generators, so pipelines are
+ * chains of generators that pass pointers along without copying.
+ */
+
+struct gen;
+
+/**
+ * gen_fnc_t defines the signature of a producer. It calls gen_yield() on
+ * gen for every value, and the generator is exhausted once it returns.
+ */
+
+typedef void (*gen_fnc_t)(struct gen *gen, void *arg);
+
+/**
+ * Creates a generator; the producer does not run until the first
+ * gen_next().
+ *
+ * fnc: the producer
+ * arg: a pass-through pointer handed to the producer
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct gen *gen_open(gen_fnc_t fnc, void *arg);
+
+/**
+ * Destroys a generator. A producer that has not returned is abandoned
+ * where it last yielded; nothing on its stack is unwound.
+ *
+ * Note: gen may be NULL
+ */
+
+void gen_close(struct gen *gen);
+
+/**
+ * Runs the producer until its next gen_yield() or until it returns.
+ * Must not be called from the generator's own producer.
+ *
+ * value: receives the yielded value, may be NULL
+ *
+ * return: 1 if a value was yielded, 0 if the generator is exhausted
+ */
+
+int gen_next(struct gen *gen, void **value);
+
+/**
+ * Called by the producer of gen to hand value to the consumer and suspend
+ * until the next gen_next().
+ */
+
+void gen_yield(struct gen *gen, void *value);
+
+#endif /* _GEN_H_ */
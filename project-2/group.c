@@ -0,0 +1,183 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * group.c
+ */
+
+#include "group.h"
+
+/**
+ * A child learns that it finished through a fiber-local storage
+ * destructor, which runs both when it returns and when it exits early,
+ * cancelled or by scheduler_exit(). Its member record is queued on done,
+ * where the job handle waits for scheduler_group_wait() to join it. The
+ * record, not the job, is queued since the job may still park in other
+ * destructors on its way out.
+ *
+ * The group is freed with its scope: closing it drops the group's own
+ * reference, and the children's descendants, which inherit the scope and
+ * may outlive the close, hold theirs until they terminate.
+ */
+
+struct scheduler_group {
+        struct scheduler_scope scope;
+        int lock;
+        size_t running; /* spawned and not yet finished */
+        struct member* head; /* finished and not yet joined, FIFO */
+        struct member* tail;
+        struct scheduler_queue waiters;
+};
+
+struct member {
+        struct scheduler_group* group;
+        scheduler_fnc_t fnc;
+        void* arg;
+        struct job* job;
+        struct member* next;
+};
+
+static scheduler_key_t key;
+static int key_ok;
+static int key_lock;
+
+static void group_exit(void* arg) {
+        struct scheduler_queue woken;
+        struct scheduler_group* group;
+        struct member* member;
+        struct job* j;
+
+        member = (struct member*)arg;
+        group = member->group;
+        woken.head = NULL;
+        woken.tail = NULL;
+        member->job = scheduler_self();
+        member->next = NULL;
+        scheduler_lock(&group->lock);
+        if (group->tail) {
+                group->tail->next = member;
+        } else {
+                group->head = member;
+        }
+        group->tail = member;
+        if (0 == --group->running) {
+                /* nothing more to wait for, release every waiter */
+                while (NULL != (j = scheduler_queue_pop(&group->waiters))) {
+                        scheduler_queue_push(&woken, j);
+                }
+        } else if (NULL != (j = scheduler_queue_pop(&group->waiters))) {
+                scheduler_queue_push(&woken, j);
+        }
+        scheduler_unlock(&group->lock);
+        while (NULL != (j = scheduler_queue_pop(&woken))) {
+                scheduler_unpark(j);
+        }
+}
+
+static void group_entry(void* arg) {
+        struct member* member;
+
+        member = (struct member*)arg;
+        if (scheduler_setspecific(key, member)) {
+                EXIT("out of memory");
+        }
+        member->fnc(member->arg);
+}
+
+static void group_release(struct scheduler_scope* scope) {
+        /* scope is the group's first member */
+        scheduler_free((struct scheduler_group*)scope);
+}
+
+struct scheduler_group *scheduler_group_open(void) {
+        struct scheduler_group* group;
+        struct job* self;
+
+        scheduler_lock(&key_lock);
+        if (!key_ok && !scheduler_key_create(&key, group_exit)) {
+                key_ok = 1;
+        }
+        scheduler_unlock(&key_lock);
+        if (!key_ok) {
+                return NULL;
+        }
+        if (!(group = (struct scheduler_group*)scheduler_malloc(sizeof (struct scheduler_group)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(group, 0, sizeof (struct scheduler_group));
+        self = scheduler_self();
+        scheduler_scope_init(&group->scope, self ? self->scope : NULL, group_release);
+        return group;
+}
+
+void scheduler_group_close(struct scheduler_group *group) {
+        if (group) {
+                scheduler_group_wait_all(group);
+                scheduler_scope_put(&group->scope);
+        }
+}
+
+int scheduler_group_spawn(struct scheduler_group *group, scheduler_fnc_t fnc, void *arg) {
+        struct member* member;
+
+        if (!(member = (struct member*)scheduler_malloc(sizeof (struct member)))) {
+                TRACE("out of memory");
+                return -1;
+        }
+        member->group = group;
+        member->fnc = fnc;
+        member->arg = arg;
+        scheduler_lock(&group->lock);
+        group->running++;
+        scheduler_unlock(&group->lock);
+        if (!scheduler_create_in(&group->scope, group_entry, member)) {
+                scheduler_lock(&group->lock);
+                group->running--;
+                scheduler_unlock(&group->lock);
+                scheduler_free(member);
+                return -1;
+        }
+        return 0;
+}
+
+int scheduler_group_wait(struct scheduler_group *group, void **result) {
+        struct member* member;
+        struct job* self;
+        struct job* j;
+
+        scheduler_lock(&group->lock);
+        while (NULL == (member = group->head)) {
+                if (!group->running) {
+                        scheduler_unlock(&group->lock);
+                        return 0;
+                }
+                assert( scheduler_self() );
+                scheduler_queue_push(&group->waiters, scheduler_self());
+                scheduler_park(&group->lock);
+                scheduler_lock(&group->lock);
+        }
+        if (NULL == (group->head = member->next)) {
+                group->tail = NULL;
+        }
+        j = member->job;
+        scheduler_unlock(&group->lock);
+        scheduler_free(member);
+        /* a finished child is joined even if the caller was cancelled */
+        self = scheduler_self();
+        self->critical++;
+        scheduler_join(j, result);
+        self->critical--;
+        return 1;
+}
+
+void scheduler_group_wait_all(struct scheduler_group *group) {
+        while (scheduler_group_wait(group, NULL)) {
+        }
+}
+
+void scheduler_group_cancel(struct scheduler_group *group) {
+        scheduler_scope_cancel(&group->scope);
+}
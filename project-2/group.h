@@ -0,0 +1,80 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * group.h
+ */
+
+#ifndef _GROUP_H_
+#define _GROUP_H_
+
+#include "scheduler.h"
+
+/**
+ * Task groups for structured concurrency. A parent spawns children into a
+ * group, waits for the first or for all of them, and may cancel the ones
+ * still running. Cancellation is deferred (see scheduler_testcancel()):
+ * a cancelled child exits at its next cancellation point. It covers every
+ * user thread the children create, and the children of groups opened
+ * inside them.
+ *
+ * Note: waiting and closing must be done from within a user thread.
+ */
+
+struct scheduler_group;
+
+/**
+ * Creates an empty group, nested in the scope of the calling user thread.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct scheduler_group *scheduler_group_open(void);
+
+/**
+ * Waits for the children still running, then destroys the group. The
+ * threads the children created outside it keep the group's scope until
+ * they terminate.
+ *
+ * Note: group may be NULL
+ */
+
+void scheduler_group_close(struct scheduler_group *group);
+
+/**
+ * Creates a child user thread in group.
+ *
+ * return: 0 on success, -1 on error
+ */
+
+int scheduler_group_spawn(struct scheduler_group *group, scheduler_fnc_t fnc, void *arg);
+
+/**
+ * Waits for the next child to finish, in the order they finish.
+ *
+ * result: receives the child's exit value, SCHEDULER_CANCELED if it was
+ *         cancelled; may be NULL
+ *
+ * return: 1 if a child finished, 0 if the group has no children left
+ */
+
+int scheduler_group_wait(struct scheduler_group *group, void **result);
+
+/**
+ * Waits for all children to finish.
+ */
+
+void scheduler_group_wait_all(struct scheduler_group *group);
+
+/**
+ * Cancels every child of group, running or yet to be spawned. Children
+ * parked in a wait that is a cancellation point are woken to exit. Waiting
+ * on the group itself is not a cancellation point, closing a group always
+ * waits for its children.
+ */
+
+void scheduler_group_cancel(struct scheduler_group *group);
+
+#endif /* _GROUP_H_ */
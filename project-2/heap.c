@@ -0,0 +1,114 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * heap.c
+ */
+
+#include "heap.h"
+
+#define HEAP_SLOTS 16
+
+struct entry {
+        uint64_t key;
+        struct job* job;
+};
+
+struct heap {
+        size_t size;
+        size_t capacity;
+        struct entry* entry;
+};
+
+static void swap(struct entry* a, struct entry* b) {
+        struct entry t;
+
+        t = *a;
+        *a = *b;
+        *b = t;
+}
+
+struct heap *heap_open(void) {
+        struct heap* heap;
+
+        if (!(heap = (struct heap*)malloc(sizeof (struct heap)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        heap->size = 0;
+        heap->capacity = HEAP_SLOTS;
+        if (!(heap->entry = (struct entry*)malloc(heap->capacity * sizeof (struct entry)))) {
+                TRACE("out of memory");
+                free(heap);
+                return NULL;
+        }
+        return heap;
+}
+
+void heap_close(struct heap *heap) {
+        if (heap) {
+                free(heap->entry);
+                free(heap);
+        }
+}
+
+int heap_push(struct heap *heap, uint64_t key, struct job *job) {
+        struct entry* entry;
+        size_t i;
+
+        if (heap->size == heap->capacity) {
+                entry = (struct entry*)realloc(heap->entry,
+                                               2 * heap->capacity * sizeof (struct entry));
+                if (!entry) {
+                        TRACE("out of memory");
+                        return -1;
+                }
+                heap->entry = entry;
+                heap->capacity *= 2;
+        }
+
+        i = heap->size++;
+        heap->entry[i].key = key;
+        heap->entry[i].job = job;
+        while (i && (heap->entry[(i - 1) / 2].key > heap->entry[i].key)) {
+                swap(&heap->entry[(i - 1) / 2], &heap->entry[i]);
+                i = (i - 1) / 2;
+        }
+        return 0;
+}
+
+struct job *heap_pop(struct heap *heap) {
+        struct job* job;
+        size_t i;
+        size_t c;
+
+        if (!heap->size) {
+                return NULL;
+        }
+        job = heap->entry[0].job;
+        heap->entry[0] = heap->entry[--heap->size];
+
+        i = 0;
+        while ((c = 2 * i + 1) < heap->size) {
+                if (((c + 1) < heap->size) &&
+                    (heap->entry[c + 1].key < heap->entry[c].key)) {
+                        ++c;
+                }
+                if (heap->entry[i].key <= heap->entry[c].key) {
+                        break;
+                }
+                swap(&heap->entry[i], &heap->entry[c]);
+                i = c;
+        }
+        return job;
+}
+
+uint64_t heap_min(const struct heap *heap) {
+        return heap->size ? heap->entry[0].key : UINT64_MAX;
+}
+
+size_t heap_size(const struct heap *heap) {
+        return heap->size;
+}
@@ -0,0 +1,65 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * heap.h
+ */
+
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include "system.h"
+
+struct job;
+struct heap;
+
+/**
+ * Creates an empty binary min-heap of jobs ordered by a 64-bit key. Not
+ * thread-safe.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct heap *heap_open(void);
+
+/**
+ * Destroys a heap previously obtained by calling heap_open().
+ *
+ * Note: heap may be NULL
+ */
+
+void heap_close(struct heap *heap);
+
+/**
+ * Inserts job with the given key.
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int heap_push(struct heap *heap, uint64_t key, struct job *job);
+
+/**
+ * Removes the job with the smallest key.
+ *
+ * return: the job or NULL if the heap is empty
+ */
+
+struct job *heap_pop(struct heap *heap);
+
+/**
+ * Returns the smallest key without removing it.
+ *
+ * return: the smallest key or UINT64_MAX if the heap is empty
+ */
+
+uint64_t heap_min(const struct heap *heap);
+
+/**
+ * Returns the number of jobs in the heap.
+ */
+
+size_t heap_size(const struct heap *heap);
+
+#endif /* _HEAP_H_ */
@@ -19,7 +19,7 @@ _thread_(void *arg)
 	name = (const char *)arg;
 	for (i=0; i<100; ++i) {
 		printf("%s %d\n", name, i);
-		us_sleep(20000);
+		scheduler_sleep(20000);
 		/* scheduler_yield(); */
 	}
 }
@@ -27,23 +27,27 @@ _thread_(void *arg)
 int
 main(int argc, char *argv[])
 {
+	const char *names[] = { "hello", "world", "love", "this", "course!" };
+	struct job *threads[ARRAY_SIZE(names)];
+	size_t i;
+
 	UNUSED(argc);
 	UNUSED(argv);
 
-        scheduler_init();
+        scheduler_init(NULL);
 
-	if (scheduler_create(_thread_, "hello") ||
-            scheduler_create(_thread_, "world") ||
-	    scheduler_create(_thread_, "love") ||
-	    scheduler_create(_thread_, "this") ||
-	    scheduler_create(_thread_, "course!")) {
-		TRACE(0);
-		return -1;
+	for (i=0; i<ARRAY_SIZE(names); ++i) {
+		if (!(threads[i] = scheduler_create(_thread_, (void *)names[i]))) {
+			TRACE(0);
+			return -1;
+		}
 	}
 
-        signal(SIGALRM, interrupt_handler);
-        alarm(1);
 	scheduler_execute();
 
+	for (i=0; i<ARRAY_SIZE(names); ++i) {
+		scheduler_join(threads[i], NULL);
+	}
+
 	return 0;
 }
@@ -0,0 +1,146 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * mlfq.c
+ */
+
+#include "policy.h"
+
+#define MLFQ_BOOST 64 /* quanta between two priority boosts */
+
+/**
+ * Multi-level feedback queue. Level 0 is served first and has the shortest
+ * time slice; a job that uses up its slice is demoted one level and gets a
+ * longer slice, a job that gives up the CPU within half its slice is
+ * promoted one level. A job never rises above its explicit priority, and
+ * every MLFQ_BOOST quanta all jobs are reset to their priority so that
+ * demoted batch work still makes progress.
+ */
+
+struct mlfq {
+        int lock;
+        size_t size;
+        uint64_t quantum;
+        uint64_t boosted; /* monotonic ns of the last boost */
+        struct scheduler_queue level[SCHEDULER_PRIORITIES];
+};
+
+static void mlfq_enqueue(struct mlfq* mlfq, struct job* job) {
+        job->slice = mlfq->quantum * (uint64_t)(job->level + 1);
+        scheduler_queue_push(&mlfq->level[job->level], job);
+        mlfq->size++;
+}
+
+static void* mlfq_open(uint64_t quantum) {
+        struct mlfq* mlfq;
+
+        if (!(mlfq = (struct mlfq*)malloc(sizeof (struct mlfq)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(mlfq, 0, sizeof (struct mlfq));
+        mlfq->quantum = quantum;
+        return mlfq;
+}
+
+static void mlfq_close(void* rq) {
+        free(rq);
+}
+
+static void mlfq_push(void* rq, struct job* job, int how, uint64_t now) {
+        struct mlfq* mlfq;
+
+        UNUSED(now);
+        mlfq = (struct mlfq*)rq;
+        if (POLICY_NEW == how) {
+                job->level = job->priority;
+        } else if (POLICY_PREEMPTED == how) {
+                if ((SCHEDULER_PRIORITIES - 1) > job->level) {
+                        job->level++;
+                }
+        } else if ((job->ran < (job->slice / 2)) && (job->priority < job->level)) {
+                job->level--;
+        }
+
+        scheduler_lock(&mlfq->lock);
+        mlfq_enqueue(mlfq, job);
+        scheduler_unlock(&mlfq->lock);
+}
+
+static void mlfq_boost(struct mlfq* mlfq) {
+        struct scheduler_queue demoted;
+        struct job* job;
+        int i;
+
+        for (i=1; i<SCHEDULER_PRIORITIES; ++i) {
+                demoted = mlfq->level[i];
+                mlfq->level[i].head = NULL;
+                mlfq->level[i].tail = NULL;
+                while (NULL != (job = scheduler_queue_pop(&demoted))) {
+                        mlfq->size--;
+                        job->level = job->priority;
+                        mlfq_enqueue(mlfq, job);
+                }
+        }
+}
+
+static struct job* mlfq_take(struct mlfq* mlfq) {
+        struct job* job;
+        int i;
+
+        for (i=0; i<SCHEDULER_PRIORITIES; ++i) {
+                if (NULL != (job = scheduler_queue_pop(&mlfq->level[i]))) {
+                        mlfq->size--;
+                        return job;
+                }
+        }
+        return NULL;
+}
+
+static struct job* mlfq_pop(void* rq, uint64_t now) {
+        struct mlfq* mlfq;
+        struct job* job;
+
+        mlfq = (struct mlfq*)rq;
+        scheduler_lock(&mlfq->lock);
+        if ((now - mlfq->boosted) >= (MLFQ_BOOST * mlfq->quantum)) {
+                mlfq->boosted = now;
+                mlfq_boost(mlfq);
+        }
+        job = mlfq_take(mlfq);
+        scheduler_unlock(&mlfq->lock);
+        return job;
+}
+
+static struct job* mlfq_steal(void* rq, uint64_t now) {
+        struct mlfq* mlfq;
+        struct job* job;
+
+        UNUSED(now);
+        mlfq = (struct mlfq*)rq;
+        if (!__atomic_load_n(&mlfq->size, __ATOMIC_RELAXED)) {
+                return NULL;
+        }
+        scheduler_lock(&mlfq->lock);
+        job = mlfq_take(mlfq);
+        scheduler_unlock(&mlfq->lock);
+        return job;
+}
+
+static size_t mlfq_size(void* rq) {
+        return __atomic_load_n(&((struct mlfq*)rq)->size, __ATOMIC_RELAXED);
+}
+
+const struct policy policy_mlfq = {
+        "mlfq",
+        mlfq_open,
+        mlfq_close,
+        mlfq_push,
+        mlfq_pop,
+        mlfq_steal,
+        mlfq_size,
+        0
+};
@@ -0,0 +1,115 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * parallel.c
+ */
+
+#include "parallel.h"
+
+/**
+ * A range lives on the stack of the user thread that split it off, which
+ * joins the thread working on it before returning.
+ */
+
+struct range {
+        size_t begin;
+        size_t end;
+        size_t grain;
+        scheduler_for_fnc_t fnc;
+        scheduler_map_fnc_t map;
+        scheduler_reduce_fnc_t reduce;
+        void* arg;
+        void* result;
+        int spawn; /* 0 outside the scheduler */
+};
+
+static void parallel_run(struct range* range);
+
+static void parallel_entry(void* arg) {
+        parallel_run((struct range*)arg);
+}
+
+static void parallel_run(struct range* range) {
+        struct range left;
+        struct range right;
+        struct job* job;
+        size_t mid;
+
+        if ((range->end - range->begin) <= range->grain) {
+                if (range->map) {
+                        range->result = range->map(range->begin, range->end, range->arg);
+                } else {
+                        range->fnc(range->begin, range->end, range->arg);
+                }
+                return;
+        }
+        mid = range->begin + (range->end - range->begin) / 2;
+        left = *range;
+        left.end = mid;
+        right = *range;
+        right.begin = mid;
+
+        /* out of memory is no reason to fail, the half just runs here */
+        job = range->spawn ? scheduler_create(parallel_entry, &right) : NULL;
+        parallel_run(&left);
+        if (!job) {
+                parallel_run(&right);
+        } else if (scheduler_join(job, NULL)) {
+                /* right may still be running, and it lives on this stack */
+                EXIT("scheduler_join()");
+        }
+        if (range->map) {
+                range->result = range->reduce(left.result, right.result, range->arg);
+        }
+}
+
+static void* parallel(struct range* range, void* identity) {
+        if (range->begin >= range->end) {
+                return identity;
+        }
+        if (!range->grain) {
+                range->grain = (range->end - range->begin) / PARALLEL_CHUNKS;
+                range->grain = range->grain ? range->grain : 1;
+        }
+        range->spawn = scheduler_self() ? 1 : 0;
+        parallel_run(range);
+        return range->result;
+}
+
+void scheduler_parallel_for(size_t begin,
+                            size_t end,
+                            size_t grain,
+                            scheduler_for_fnc_t fnc,
+                            void *arg) {
+        struct range range;
+
+        memset(&range, 0, sizeof (range));
+        range.begin = begin;
+        range.end = end;
+        range.grain = grain;
+        range.fnc = fnc;
+        range.arg = arg;
+        parallel(&range, NULL);
+}
+
+void *scheduler_parallel_reduce(size_t begin,
+                                size_t end,
+                                size_t grain,
+                                scheduler_map_fnc_t map,
+                                scheduler_reduce_fnc_t reduce,
+                                void *identity,
+                                void *arg) {
+        struct range range;
+
+        memset(&range, 0, sizeof (range));
+        range.begin = begin;
+        range.end = end;
+        range.grain = grain;
+        range.map = map;
+        range.reduce = reduce;
+        range.arg = arg;
+        return parallel(&range, identity);
+}
@@ -0,0 +1,63 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * parallel.h
+ */
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "scheduler.h"
+
+/**
+ * Data-parallel loops over user threads. The range [begin, end) is split
+ * in halves recursively, one half going to a new user thread and the
+ * other kept by the splitting one, until pieces are at most grain long.
+ * Idle workers steal the oldest, thus largest, pieces first, so the loop
+ * balances across cores.
+ *
+ * grain: the largest range handed to a single call of fnc or map; 0 splits
+ *        the range into about PARALLEL_CHUNKS pieces
+ *
+ * Note: called outside a user thread, the loop runs sequentially on the
+ *       calling thread, in pieces of grain.
+ */
+
+#define PARALLEL_CHUNKS 64
+
+typedef void (*scheduler_for_fnc_t)(size_t begin, size_t end, void *arg);
+
+typedef void *(*scheduler_map_fnc_t)(size_t begin, size_t end, void *arg);
+
+typedef void *(*scheduler_reduce_fnc_t)(void *a, void *b, void *arg);
+
+/**
+ * Calls fnc on pieces covering [begin, end) and returns once all returned.
+ */
+
+void scheduler_parallel_for(size_t begin,
+                            size_t end,
+                            size_t grain,
+                            scheduler_for_fnc_t fnc,
+                            void *arg);
+
+/**
+ * Calls map on pieces covering [begin, end) and combines their results
+ * pairwise with reduce, always as reduce(left, right, arg) for adjacent
+ * pieces in order, so reduce need only be associative.
+ *
+ * return: the combined result, identity for an empty range
+ */
+
+void *scheduler_parallel_reduce(size_t begin,
+                                size_t end,
+                                size_t grain,
+                                scheduler_map_fnc_t map,
+                                scheduler_reduce_fnc_t reduce,
+                                void *identity,
+                                void *arg);
+
+#endif /* _PARALLEL_H_ */
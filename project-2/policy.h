@@ -0,0 +1,57 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * policy.h
+ */
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include "scheduler.h"
+
+/**
+ * A scheduling policy owns one run queue per worker. The worker pushes
+ * every job that becomes runnable on its own run queue, saying why, and
+ * pops the next job to run from it; idle workers steal from the others.
+ *
+ * Run queues are called both from their worker and from thieves, so a
+ * policy synchronizes internally (scheduler_lock() or lock-free). When a
+ * job is pushed after running, job->ran holds how long it just ran, in ns.
+ *
+ * open   : creates a run queue; quantum is the scheduler quantum in ns
+ * close  : destroys an empty run queue
+ * push   : makes job runnable; how is one of the POLICY_ values
+ * pop    : removes the next job to run, or returns NULL
+ * steal  : like pop, but called by another worker
+ * size   : a racy count of the runnable jobs
+ * handoff: if non-zero, a woken job may bypass the run queue and run next
+ *          on the waker's worker
+ */
+
+enum {
+        POLICY_NEW,       /* just created */
+        POLICY_YIELDED,   /* gave up the CPU voluntarily */
+        POLICY_PREEMPTED, /* used up its time slice */
+        POLICY_WOKEN      /* done sleeping, waiting for I/O or parked */
+};
+
+struct policy {
+        const char* name;
+        void* (*open)(uint64_t quantum);
+        void (*close)(void* rq);
+        void (*push)(void* rq, struct job* job, int how, uint64_t now);
+        struct job* (*pop)(void* rq, uint64_t now);
+        struct job* (*steal)(void* rq, uint64_t now);
+        size_t (*size)(void* rq);
+        int handoff;
+};
+
+extern const struct policy policy_rr;
+extern const struct policy policy_mlfq;
+extern const struct policy policy_cfs;
+extern const struct policy policy_edf;
+
+#endif /* _POLICY_H_ */
@@ -0,0 +1,273 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * rbtree.c
+ */
+
+#include "rbtree.h"
+
+/**
+ * Cormen et al., Introduction to Algorithms, chapter 13, with NULL leaves
+ * instead of a sentinel; the removal fixup therefore tracks the parent of
+ * the possibly NULL node it starts from.
+ */
+
+static int is_red(const struct rbnode* node) {
+        return node && node->red;
+}
+
+static void rotate_left(struct rbtree* tree, struct rbnode* x) {
+        struct rbnode* y;
+
+        y = x->right;
+        x->right = y->left;
+        if (y->left) {
+                y->left->parent = x;
+        }
+        y->parent = x->parent;
+        if (!x->parent) {
+                tree->root = y;
+        } else if (x == x->parent->left) {
+                x->parent->left = y;
+        } else {
+                x->parent->right = y;
+        }
+        y->left = x;
+        x->parent = y;
+}
+
+static void rotate_right(struct rbtree* tree, struct rbnode* x) {
+        struct rbnode* y;
+
+        y = x->left;
+        x->left = y->right;
+        if (y->right) {
+                y->right->parent = x;
+        }
+        y->parent = x->parent;
+        if (!x->parent) {
+                tree->root = y;
+        } else if (x == x->parent->right) {
+                x->parent->right = y;
+        } else {
+                x->parent->left = y;
+        }
+        y->right = x;
+        x->parent = y;
+}
+
+static void transplant(struct rbtree* tree, struct rbnode* u, struct rbnode* v) {
+        if (!u->parent) {
+                tree->root = v;
+        } else if (u == u->parent->left) {
+                u->parent->left = v;
+        } else {
+                u->parent->right = v;
+        }
+        if (v) {
+                v->parent = u->parent;
+        }
+}
+
+static struct rbnode* minimum(struct rbnode* node) {
+        while (node->left) {
+                node = node->left;
+        }
+        return node;
+}
+
+static struct rbnode* successor(struct rbnode* node) {
+        if (node->right) {
+                return minimum(node->right);
+        }
+        while (node->parent && (node == node->parent->right)) {
+                node = node->parent;
+        }
+        return node->parent;
+}
+
+void rbtree_init(struct rbtree *tree) {
+        tree->root = NULL;
+        tree->leftmost = NULL;
+        tree->size = 0;
+}
+
+void rbtree_insert(struct rbtree *tree, struct rbnode *node, rbtree_less_t less) {
+        struct rbnode** link;
+        struct rbnode* parent;
+        struct rbnode* uncle;
+        struct rbnode* grand;
+        int leftmost;
+
+        parent = NULL;
+        link = &tree->root;
+        leftmost = 1;
+        while (*link) {
+                parent = *link;
+                if (less(node, parent)) {
+                        link = &parent->left;
+                } else {
+                        link = &parent->right;
+                        leftmost = 0;
+                }
+        }
+        node->parent = parent;
+        node->left = NULL;
+        node->right = NULL;
+        node->red = 1;
+        *link = node;
+        if (leftmost) {
+                tree->leftmost = node;
+        }
+        tree->size++;
+
+        while ((parent = node->parent) && parent->red) {
+                grand = parent->parent;
+                if (parent == grand->left) {
+                        uncle = grand->right;
+                        if (is_red(uncle)) {
+                                parent->red = 0;
+                                uncle->red = 0;
+                                grand->red = 1;
+                                node = grand;
+                                continue;
+                        }
+                        if (node == parent->right) {
+                                rotate_left(tree, parent);
+                                node = parent;
+                                parent = node->parent;
+                        }
+                        parent->red = 0;
+                        grand->red = 1;
+                        rotate_right(tree, grand);
+                } else {
+                        uncle = grand->left;
+                        if (is_red(uncle)) {
+                                parent->red = 0;
+                                uncle->red = 0;
+                                grand->red = 1;
+                                node = grand;
+                                continue;
+                        }
+                        if (node == parent->left) {
+                                rotate_right(tree, parent);
+                                node = parent;
+                                parent = node->parent;
+                        }
+                        parent->red = 0;
+                        grand->red = 1;
+                        rotate_left(tree, grand);
+                }
+        }
+        tree->root->red = 0;
+}
+
+static void remove_fixup(struct rbtree* tree, struct rbnode* x, struct rbnode* parent) {
+        struct rbnode* w;
+
+        while ((x != tree->root) && !is_red(x)) {
+                if (x == parent->left) {
+                        w = parent->right;
+                        if (is_red(w)) {
+                                w->red = 0;
+                                parent->red = 1;
+                                rotate_left(tree, parent);
+                                w = parent->right;
+                        }
+                        if (!is_red(w->left) && !is_red(w->right)) {
+                                w->red = 1;
+                                x = parent;
+                                parent = x->parent;
+                                continue;
+                        }
+                        if (!is_red(w->right)) {
+                                w->left->red = 0;
+                                w->red = 1;
+                                rotate_right(tree, w);
+                                w = parent->right;
+                        }
+                        w->red = parent->red;
+                        parent->red = 0;
+                        w->right->red = 0;
+                        rotate_left(tree, parent);
+                } else {
+                        w = parent->left;
+                        if (is_red(w)) {
+                                w->red = 0;
+                                parent->red = 1;
+                                rotate_right(tree, parent);
+                                w = parent->left;
+                        }
+                        if (!is_red(w->left) && !is_red(w->right)) {
+                                w->red = 1;
+                                x = parent;
+                                parent = x->parent;
+                                continue;
+                        }
+                        if (!is_red(w->left)) {
+                                w->right->red = 0;
+                                w->red = 1;
+                                rotate_left(tree, w);
+                                w = parent->left;
+                        }
+                        w->red = parent->red;
+                        parent->red = 0;
+                        w->left->red = 0;
+                        rotate_right(tree, parent);
+                }
+                x = tree->root;
+                break;
+        }
+        if (x) {
+                x->red = 0;
+        }
+}
+
+void rbtree_remove(struct rbtree *tree, struct rbnode *node) {
+        struct rbnode* parent;
+        struct rbnode* x;
+        struct rbnode* y;
+        int red;
+
+        if (tree->leftmost == node) {
+                tree->leftmost = successor(node);
+        }
+        tree->size--;
+
+        red = node->red;
+        if (!node->left) {
+                x = node->right;
+                parent = node->parent;
+                transplant(tree, node, node->right);
+        } else if (!node->right) {
+                x = node->left;
+                parent = node->parent;
+                transplant(tree, node, node->left);
+        } else {
+                y = minimum(node->right);
+                red = y->red;
+                x = y->right;
+                if (y->parent == node) {
+                        parent = y;
+                } else {
+                        parent = y->parent;
+                        transplant(tree, y, y->right);
+                        y->right = node->right;
+                        y->right->parent = y;
+                }
+                transplant(tree, node, y);
+                y->left = node->left;
+                y->left->parent = y;
+                y->red = node->red;
+        }
+        if (!red) {
+                remove_fixup(tree, x, parent);
+        }
+}
+
+struct rbnode *rbtree_first(const struct rbtree *tree) {
+        return tree->leftmost;
+}
@@ -0,0 +1,52 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * rbtree.h
+ */
+
+#ifndef _RBTREE_H_
+#define _RBTREE_H_
+
+#include "system.h"
+
+/**
+ * An intrusive red-black tree: the rbnode is embedded in the element and
+ * the caller maps it back with offsetof(). Equal keys are kept in insertion
+ * order. Not thread-safe.
+ */
+
+struct rbnode {
+        struct rbnode* parent;
+        struct rbnode* left;
+        struct rbnode* right;
+        int red;
+};
+
+struct rbtree {
+        struct rbnode* root;
+        struct rbnode* leftmost; /* cached smallest node */
+        size_t size;
+};
+
+/**
+ * Returns non-zero if a orders strictly before b.
+ */
+
+typedef int (*rbtree_less_t)(const struct rbnode *a, const struct rbnode *b);
+
+void rbtree_init(struct rbtree *tree);
+
+void rbtree_insert(struct rbtree *tree, struct rbnode *node, rbtree_less_t less);
+
+void rbtree_remove(struct rbtree *tree, struct rbnode *node);
+
+/**
+ * Returns the smallest node in O(1), or NULL if the tree is empty.
+ */
+
+struct rbnode *rbtree_first(const struct rbtree *tree);
+
+#endif /* _RBTREE_H_ */
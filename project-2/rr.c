@@ -0,0 +1,54 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * rr.c
+ */
+
+#include "deque.h"
+#include "policy.h"
+
+#define DEQUE_SLOTS 64
+
+/**
+ * Round-robin over a Chase-Lev work-stealing deque. The owner takes jobs
+ * from the top like a thief would, so that jobs pushed at the bottom
+ * rotate in FIFO order.
+ */
+
+static void* rr_open(uint64_t quantum) {
+        UNUSED(quantum);
+        return deque_open(DEQUE_SLOTS);
+}
+
+static void rr_close(void* rq) {
+        deque_close((struct deque*)rq);
+}
+
+static void rr_push(void* rq, struct job* job, int how, uint64_t now) {
+        UNUSED(how);
+        UNUSED(now);
+        deque_push((struct deque*)rq, job);
+}
+
+static struct job* rr_pop(void* rq, uint64_t now) {
+        UNUSED(now);
+        return deque_steal((struct deque*)rq);
+}
+
+static size_t rr_size(void* rq) {
+        return deque_size((struct deque*)rq);
+}
+
+const struct policy policy_rr = {
+        "rr",
+        rr_open,
+        rr_close,
+        rr_push,
+        rr_pop,
+        rr_pop,
+        rr_size,
+        1
+};
@@ -7,142 +7,2007 @@
  * scheduler.c
  */
 
+#define _GNU_SOURCE
 #undef _FORTIFY_SOURCE
 
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
 #include "system.h"
+#include "heap.h"
+#include "policy.h"
+#include "trace.h"
 #include "scheduler.h"
 
+#define STACK_PAGES 3 /* stack of a thread function not yet measured */
+#define STACK_CANARY 0x5ca1ab1edeadbeefUL
+#define STACK_RESERVE 1024 /* interrupt_handler() down to setjmp() */
+#define STACK_PROBE (64 * 1024)
+#define ALTSTACK (64 * 1024) /* SIGALRM stack of a worker in poll mode */
+#define STACK_ROUND 1024
+#define STACK_MAX (1024 * 1024)
+#define STACK_SAMPLES 16 /* first threads of a function all measured */
+#define STACK_SAMPLE_EVERY 256 /* then one in this many */
+#define STACK_FNCS 256
+#define EPOLL_EVENTS 64
+#define OFFLOAD_THREADS 4
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 /**
  * Needs:
  *   setjmp()
  *   longjmp()
+ *   pthread_create()
+ *   pthread_join()
+ *   epoll_create1()
+ *   epoll_ctl()
+ *   epoll_wait()
+ *   eventfd()
+ *   fcntl()
+ *   pthread_sigmask()
+ *   sigaction()
+ *   sigtimedwait()
+ *   timer_create()
+ *   timer_settime()
+ *   timer_delete()
+ *   setitimer()
+ *   sysconf()
  */
 
 /* research the above Needed API and design accordingly */
 
+enum { OP_YIELD, OP_PREEMPT, OP_EXIT, OP_SLEEP, OP_IO, OP_PARK, OP_OFFLOAD };
+
+static const char* const _ops_[] = {
+        "yield", "preempt", "exit", "sleep", "io", "park", "offload"
+};
+
+/**
+ * a blocking call handed to the helper threads; it lives on the stack of
+ * the parked job that made it
+ */
+struct offload {
+        scheduler_offload_fnc_t fnc;
+        void* arg;
+        void* result;
+        struct job* job;
+        struct worker* home; /* the worker to hand the job back to */
+        struct offload* next;
+};
+
+/**
+ * fdwait holds the jobs a worker has parked on one fd. epoll keeps a single
+ * registration per fd, so it is armed for the union of what they wait for.
+ */
+struct fdwait {
+        struct scheduler_queue readers;
+        struct scheduler_queue writers;
+};
+
+/**
+ * worker is one kernel thread of the scheduler. It owns a run queue of the
+ * scheduling policy and the context the running job switches back to.
+ */
+struct worker {
+        jmp_buf env;
+        pthread_t thread;
+        int started;
+        int timed; /* 1: own timer_create() timer, 2: process setitimer() */
+        timer_t timer;
+        sigset_t mask; /* signal mask to restore when the worker stops */
+        size_t id;
+        unsigned seed; /* victim selection */
+        void* rq; /* run queue of sch_obj->policy */
+        struct heap* sleepers; /* jobs in scheduler_sleep() by deadline */
+        int epfd; /* reactor: fds of parked jobs plus evfd */
+        int evfd; /* written to wake the worker out of epoll_wait() */
+        int sleeping; /* 1 while blocked in epoll_wait() */
+        size_t waiting; /* jobs parked on epfd */
+        struct fdwait* fds; /* indexed by fd, grown on demand */
+        size_t nfds;
+        uint64_t polled; /* monotonic ns of the last reactor poll */
+        struct job* curr;
+        struct job* runnext; /* woken job handed the CPU next, not stealable */
+        int inherit; /* 1 if curr came from runnext and shares its slice */
+        uint64_t slice; /* monotonic ns the current time slice began */
+        int op; /* why curr switched back to the worker */
+        int* unlock; /* spinlock released once curr is parked */
+        struct offload* offload; /* call of curr to hand to the helpers */
+        struct job* offloaded; /* jobs whose call completed, pushed by helpers */
+        struct scheduler_stats stats; /* of the jobs this worker ran */
+        void* altstack; /* poll mode only */
+        stack_t old_altstack;
+};
+
+struct scheduler {
+        const struct policy* policy;
+        struct worker* workers;
+        size_t n;
+        size_t next; /* round-robin placement before scheduler_execute() */
+        size_t live; /* jobs created but not yet terminated */
+        uint64_t ids; /* last job id handed out */
+        uint64_t utilization; /* admitted periodic load, in ppm of a worker */
+        size_t idle; /* workers blocked waiting for work */
+        uint64_t quantum; /* preemption timer period in ns */
+        int poll; /* 1: ticks only request a yield at the next safepoint */
+        struct sigaction action; /* SIGALRM action replaced while executing */
+        pthread_mutex_t mutex; /* guards the offload fields below */
+        pthread_cond_t cond;
+        pthread_t helpers[OFFLOAD_THREADS];
+        size_t nhelpers; /* started on the first offload */
+        int stop;
+        struct offload* head; /* calls waiting for a helper, FIFO */
+        struct offload* tail;
+};
+
 struct scheduler* sch_obj = NULL;
 
-void scheduler_init(void) {
-        sch_obj = (struct scheduler*)malloc(sizeof(struct scheduler));
-        sch_obj->head = NULL;
+/**
+ * kept across scheduler_execute() so they can be read once it returned,
+ * reset by scheduler_init()
+ */
+static struct trace* _trace_;
+static struct scheduler_stats _totals_;
+
+/**
+ * fiber-local storage keys, process wide like pthread keys
+ */
+static struct {
+        int used;
+        void (*destructor)(void*);
+} _keys_[SCHEDULER_KEYS];
+static int _keys_lock_;
+
+/**
+ * measured stack use by thread function, an open-addressing hash table
+ */
+static struct {
+        scheduler_fnc_t fnc;
+        uint64_t jobs; /* threads created */
+        uint64_t samples; /* stacks scanned */
+        size_t high_water; /* deepest use in bytes */
+} _stacks_[STACK_FNCS];
+static int _stacks_lock_;
+static size_t _sigframe_; /* bytes a signal delivery takes on a stack */
+
+/**
+ * _self_ is the worker running on this kernel thread and _curr_ the job it
+ * is running (NULL while in the worker loop). Outside a critical section a
+ * job can be preempted and resumed on another kernel thread between any
+ * two instructions, so it must never hold on to a TLS address: the
+ * variables use the initial-exec model, which reads them with a single
+ * %fs-relative load, and are only read through the noinline accessors
+ * below, which the compiler cannot fold across a _switch_(). What a job
+ * learns from _self_ is valid only while _curr_->critical is raised and
+ * has to be read again after every switch.
+ */
+static __thread struct worker* _self_tls_ __attribute__((tls_model("initial-exec")));
+static __thread struct job* _curr_tls_ __attribute__((tls_model("initial-exec")));
+
+static struct worker* _self_get_(void) __attribute__((noinline));
+static struct job* _curr_get_(void) __attribute__((noinline));
+
+static struct worker* _self_get_(void) {
+        __asm__ volatile ("" ::: "memory");
+        return _self_tls_;
 }
 
-int scheduler_create(scheduler_fnc_t fnc, void* arg) {
-        /**
-         * create a task using the given function and arg
-         * add the task to the job queue in the scheduler
-         * optional - taking lock on job queue
-         */
+static struct job* _curr_get_(void) {
+        __asm__ volatile ("" ::: "memory");
+        return _curr_tls_;
+}
+
+#define _self_ (_self_get_())
+#define _curr_ (_curr_get_())
+
+__thread volatile sig_atomic_t scheduler_preempt_pending;
+
+static void _entry_(void);
+
+static uint64_t _now_(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void _enter_(void) {
+        if (_curr_) {
+                _curr_->critical++;
+        }
+}
+
+static void _leave_(void) {
+        if (_curr_) {
+                _curr_->critical--;
+        }
+}
+
+/**
+ * returns the entry of fnc in _stacks_, adding it if needed, or -1 if the
+ * table is full; _stacks_lock_ must be held
+ */
+static int _stack_find_(scheduler_fnc_t fnc) {
+        size_t h;
+        size_t i;
+
+        h = ((size_t)fnc >> 4) * 2654435761UL;
+        for (i=0; i<STACK_FNCS; ++i) {
+                h = (h + 1) % STACK_FNCS;
+                if (fnc == _stacks_[h].fnc) {
+                        return (int)h;
+                }
+                if (NULL == _stacks_[h].fnc) {
+                        _stacks_[h].fnc = fnc;
+                        return (int)h;
+                }
+        }
+        return -1;
+}
+
+/**
+ * the stack size for new jobs of entry k; in poll mode ticks are taken on
+ * the worker's alternate stack, so no signal frames need room
+ */
+static size_t _stack_size_(int k) {
+        size_t size;
+
+        if (!_stacks_[k].samples) {
+                return STACK_PAGES * page_size();
+        }
+        /* a quarter more for deeper paths that were not sampled */
+        size = _stacks_[k].high_water + _stacks_[k].high_water / 4;
+        size += (sch_obj && sch_obj->poll) ? STACK_RESERVE : _sigframe_;
+        size = (size + STACK_ROUND - 1) / STACK_ROUND * STACK_ROUND;
+        return (STACK_MAX < size) ? STACK_MAX : size;
+}
+
+/**
+ * measures how deep the exiting job j got into its canary-filled stack
+ */
+static void _stack_scan_(const struct job* j) {
+        const uint64_t* p;
+        const uint64_t* top;
+        size_t used;
+        int k;
+
+        p = (const uint64_t*)j->start_addr;
+        top = (const uint64_t*)j->stack_addr;
+        while ((p < top) && (STACK_CANARY == *p)) {
+                ++p;
+        }
+        used = (size_t)((const char*)top - (const char*)p);
+        scheduler_lock(&_stacks_lock_);
+        if (0 <= (k = _stack_find_(j->fnc))) {
+                _stacks_[k].samples++;
+                if (_stacks_[k].high_water < used) {
+                        _stacks_[k].high_water = used;
+                }
+        }
+        scheduler_unlock(&_stacks_lock_);
+}
+
+static void _sigframe_handler_(int signum) {
+        UNUSED(signum);
+}
+
+/**
+ * measures how much stack a SIGALRM delivery takes, which depends on the
+ * CPU's extended register state, by taking one on a canary-filled
+ * alternate stack; preemption ticks may nest once, so two of them plus
+ * the way down to _switch_() are reserved below every stack
+ */
+static void _sigframe_probe_(void) {
+        struct sigaction sa;
+        struct sigaction old;
+        sigset_t set;
+        sigset_t mask;
+        stack_t ss;
+        stack_t old_ss;
+        uint64_t* buf;
+        uint64_t* p;
+        size_t frame;
 
-        size_t page_size_v;
+        frame = MINSIGSTKSZ;
+        if ((buf = (uint64_t*)malloc(STACK_PROBE))) {
+                for (p=buf; p<(buf + STACK_PROBE / sizeof (uint64_t)); ++p) {
+                        *p = STACK_CANARY;
+                }
+                ss.ss_sp = buf;
+                ss.ss_size = STACK_PROBE;
+                ss.ss_flags = 0;
+                memset(&sa, 0, sizeof (sa));
+                sa.sa_handler = _sigframe_handler_;
+                sa.sa_flags = SA_ONSTACK;
+                sigemptyset(&sa.sa_mask);
+                sigemptyset(&set);
+                sigaddset(&set, SIGALRM);
+                if (!sigaltstack(&ss, &old_ss)) {
+                        if (!sigaction(SIGALRM, &sa, &old)) {
+                                pthread_sigmask(SIG_UNBLOCK, &set, &mask);
+                                raise(SIGALRM);
+                                pthread_sigmask(SIG_SETMASK, &mask, NULL);
+                                sigaction(SIGALRM, &old, NULL);
+                                for (p=buf; STACK_CANARY == *p; ++p) {
+                                }
+                                frame = STACK_PROBE - (size_t)((char*)p - (char*)buf);
+                        }
+                        sigaltstack(&old_ss, NULL);
+                }
+                free(buf);
+        }
+        _sigframe_ = 2 * frame + STACK_RESERVE;
+}
+
+static struct job* _job_alloc_(scheduler_fnc_t fnc, void* arg) {
+        uint64_t* p;
+        size_t size;
+        int profile;
+        int k;
         struct job* j;
-        struct job* last;
 
-        if (NULL == sch_obj) {
-                return -1;
+        size = STACK_PAGES * page_size();
+        profile = 0;
+        scheduler_lock(&_stacks_lock_);
+        if (0 <= (k = _stack_find_(fnc))) {
+                size = _stack_size_(k);
+                profile = (STACK_SAMPLES > _stacks_[k].jobs) ||
+                          !(_stacks_[k].jobs % STACK_SAMPLE_EVERY);
+                _stacks_[k].jobs++;
         }
+        scheduler_unlock(&_stacks_lock_);
 
-        page_size_v = page_size();
-        j = (struct job*)malloc(sizeof(struct job));
-        j->start_addr = malloc(4*page_size_v);
-        j->stack_addr = memory_align(j->start_addr, page_size_v);
-        j->stack_addr = (void *)((size_t)j->stack_addr + 3*page_size_v);
+        if (!(j = (struct job*)malloc(sizeof(struct job)))) {
+                return NULL;
+        }
+        /* malloc() alignment suffices, size keeps the top 16-byte aligned */
+        if (!(j->start_addr = malloc(size))) {
+                free(j);
+                return NULL;
+        }
+        j->stack_addr = (void *)((char *)j->start_addr + size);
+        j->stack_size = size;
+        j->profiled = profile;
+        p = (uint64_t*)j->start_addr;
+        do {
+                *p++ = STACK_CANARY;
+        } while (profile && (p < (uint64_t*)j->stack_addr));
         j->fnc = fnc;
         j->arg = arg;
         j->status = 0;
+        j->critical = 1; /* released by _entry_() */
+        j->slice = sch_obj->quantum;
+        j->dispatched = 0;
+        j->deadline = 0;
+        j->fd = -1;
+        j->events = 0;
+        j->xfer = NULL;
+        j->xfer_ok = 0;
+        j->resumed = 0;
+        j->ran = 0;
+        j->priority = 0;
+        j->level = 0;
+        j->weight = SCHEDULER_WEIGHT;
+        j->vruntime = 0;
+        j->period = 0;
+        j->budget = 0;
+        j->used = 0;
+        j->refilled = 0;
+        j->release = 0;
+        j->misses = 0;
+        j->id = 0;
+        j->readied = 0;
+        memset(&j->stats, 0, sizeof (j->stats));
+        j->specific = NULL;
+        j->scope = NULL;
+        j->queue = NULL;
+        j->waiting = NULL;
+        j->aborted = 0;
+        j->wnext = NULL;
+        j->wprev = NULL;
+        j->result = NULL;
+        j->refs = 2; /* the scheduler and the handle */
+        j->lock = 0;
+        j->joiners.head = NULL;
+        j->joiners.tail = NULL;
         j->next = NULL;
+        return j;
+}
 
-        if (NULL == sch_obj->head) {
-                sch_obj->head = j;
-                return 0;
+static void _job_put_(struct job* j) {
+        if (0 == __atomic_sub_fetch(&j->refs, 1, __ATOMIC_SEQ_CST)) {
+                free(j->start_addr);
+                free(j->specific);
+                free(j);
+        }
+}
+
+/**
+ * runs on the worker once j returned or called scheduler_exit(): the stack
+ * goes right away, the record stays until the handle is joined or detached
+ */
+static void _terminate_(struct job* j) {
+        struct scheduler_queue joiners;
+        struct job* joiner;
+
+        if (j->profiled) {
+                _stack_scan_(j);
+        }
+        FREE(j->start_addr);
+        if (j->period) {
+                __atomic_sub_fetch(&sch_obj->utilization,
+                                   (j->budget * 1000000) / j->period,
+                                   __ATOMIC_SEQ_CST);
+        }
+        /* the job is off its stack, nothing in it reads the scope again */
+        scheduler_scope_put(j->scope);
+        j->scope = NULL;
+        joiners.head = NULL;
+        joiners.tail = NULL;
+        scheduler_lock(&j->lock);
+        j->status = 2;
+        /* popped one by one, off their scopes' waiting lists as well */
+        while (NULL != (joiner = scheduler_queue_pop(&j->joiners))) {
+                scheduler_queue_push(&joiners, joiner);
+        }
+        scheduler_unlock(&j->lock);
+        while (NULL != (joiner = scheduler_queue_pop(&joiners))) {
+                scheduler_unpark(joiner);
+        }
+        _job_put_(j);
+}
+
+/**
+ * kicks one (or all) workers blocked in epoll_wait() through their eventfd
+ */
+static void _wake_(int all) {
+        struct worker* w;
+        uint64_t one;
+        size_t i;
+
+        if (!__atomic_load_n(&sch_obj->idle, __ATOMIC_SEQ_CST)) {
+                return;
+        }
+        one = 1;
+        for (i=0; i<sch_obj->n; ++i) {
+                w = &sch_obj->workers[i];
+                if (__atomic_exchange_n(&w->sleeping, 0, __ATOMIC_SEQ_CST)) {
+                        if (sizeof (one) != write(w->evfd, &one, sizeof (one))) {
+                                /* counter saturated, the worker is awake anyway */
+                        }
+                        if (!all) {
+                                return;
+                        }
+                }
         }
+}
+
+/**
+ * pushes j on the run queue of worker w
+ */
+static void _push_(struct worker* w, struct job* j, int how) {
+        j->readied = _now_();
+        sch_obj->policy->push(w->rq, j, how, j->readied);
+}
 
-        last = sch_obj->head;
+/**
+ * makes j runnable: on a worker it goes to that worker's own run queue,
+ * before scheduler_execute() the jobs are dealt round-robin across the
+ * workers
+ */
+static void _ready_(struct job* j, int how) {
+        struct worker* w;
 
-        while (NULL != last->next) {
-                last = last->next;
+        _enter_();
+        if (NULL != (w = _self_)) {
+                _push_(w, j, how);
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                _wake_(0);
+        } else {
+                w = &sch_obj->workers[sch_obj->next++ % sch_obj->n];
+                _push_(w, j, how);
         }
+        _leave_();
+}
 
-        last->next = j;
+static int _work_available_(void) {
+        size_t i;
+
+        for (i=0; i<sch_obj->n; ++i) {
+                if (sch_obj->policy->size(sch_obj->workers[i].rq)) {
+                        return 1;
+                }
+        }
         return 0;
 }
 
-void scheduler_execute(void) {
+/**
+ * the local run queue comes first; if it is empty, steal from the other
+ * workers starting at a random victim
+ */
+static struct job* _next_(struct worker* w) {
+        struct worker* v;
+        struct job* j;
+        uint64_t now;
+        size_t k;
+        size_t i;
+
+        now = _now_();
+
         /**
-         * current is pointing to currently executing task
-         * always go to next task and start executing
-         *
-         * if task is already started then call longjmp
-         * else start execution now
+         * a job woken by the previous one runs next, within the remainder
+         * of the same time slice so that two jobs waking each other
+         * cannot starve the run queue
          */
+        if (NULL != (j = w->runnext)) {
+                w->runnext = NULL;
+                if ((now - w->slice) < sch_obj->quantum) {
+                        w->inherit = 1;
+                        return j;
+                }
+                sch_obj->policy->push(w->rq, j, POLICY_WOKEN, now);
+        }
+        w->inherit = 0;
+        if (NULL != (j = sch_obj->policy->pop(w->rq, now))) {
+                return j;
+        }
+        k = (size_t)rand_r(&w->seed);
+        for (i=0; i<sch_obj->n; ++i) {
+                v = &sch_obj->workers[(k + i) % sch_obj->n];
+                if ((v != w) && (NULL != (j = sch_obj->policy->steal(v->rq, now)))) {
+                        return j;
+                }
+        }
+        return NULL;
+}
 
-        uint64_t rsp;
+/**
+ * arms fd one shot for what the jobs parked on it wait for, plus events
+ */
+static int _arm_fd_(struct worker* w, int fd, uint32_t events) {
+        struct epoll_event ev;
+        struct fdwait* f;
 
-        setjmp(sch_obj->env);
+        f = &w->fds[fd];
+        if (f->readers.head) {
+                events |= EPOLLIN;
+        }
+        if (f->writers.head) {
+                events |= EPOLLOUT;
+        }
+        if (!events) {
+                return 0;
+        }
+        ev.events = events | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, fd, &ev)) {
+                if ((ENOENT != errno) || epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+                        TRACE("epoll_ctl()");
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+/**
+ * hands the jobs of queue back to the run queue, they retry their call
+ */
+static void _resume_fd_(struct worker* w, struct scheduler_queue* queue) {
+        struct job* j;
+
+        while (NULL != (j = scheduler_queue_pop(queue))) {
+                --w->waiting;
+                _push_(w, j, POLICY_WOKEN);
+        }
+}
+
+/**
+ * harvests the jobs whose fds became ready; blocks for up to timeout
+ * milliseconds (-1 forever) if the worker has nothing else to do
+ */
+static void _poll_(struct worker* w, int timeout) {
+        struct epoll_event ev[EPOLL_EVENTS];
+        struct fdwait* f;
+        uint64_t count;
+        int fd;
+        int n;
+        int i;
+
+        w->polled = _now_();
+        if (0 < (n = epoll_wait(w->epfd, ev, EPOLL_EVENTS, timeout))) {
+                for (i=0; i<n; ++i) {
+                        if (w->evfd == (fd = ev[i].data.fd)) {
+                                if (sizeof (count) != read(w->evfd, &count, sizeof (count))) {
+                                        /* spurious */
+                                }
+                                continue;
+                        }
+                        f = &w->fds[fd];
+                        if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                                _resume_fd_(w, &f->readers);
+                        }
+                        if (ev[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                                _resume_fd_(w, &f->writers);
+                        }
+                        /* one shot disarmed the fd, re-arm it for the rest */
+                        if (_arm_fd_(w, fd, 0)) {
+                                _resume_fd_(w, &f->readers);
+                                _resume_fd_(w, &f->writers);
+                        }
+                }
+        }
+}
+
+/**
+ * blocks the worker in its reactor until another worker makes work
+ * available, a parked fd becomes ready or, if it has sleeping jobs, the
+ * earliest of their deadlines
+ */
+static void _idle_(struct worker* w, uint64_t deadline) {
+        uint64_t now;
+        int timeout;
+
+        timeout = -1;
+        if (UINT64_MAX != deadline) {
+                now = _now_();
+                /* round up, waking early would just spin */
+                timeout = (deadline <= now) ? 0 : (int)((deadline - now + 999999) / 1000000);
+        }
+
+        __atomic_add_fetch(&sch_obj->idle, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&sch_obj->live, __ATOMIC_SEQ_CST) &&
+            !_work_available_() &&
+            !__atomic_load_n(&w->offloaded, __ATOMIC_SEQ_CST)) {
+                _poll_(w, timeout);
+        }
+        __atomic_store_n(&w->sleeping, 0, __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(&sch_obj->idle, 1, __ATOMIC_SEQ_CST);
+}
 
-        sch_obj->prev = sch_obj->curr;
+/**
+ * registers the fd a job would block on with the worker's reactor, one
+ * shot, so the job is handed back exactly once when the fd is ready. A
+ * reader and a writer of the same fd are parked side by side.
+ */
+static int _park_fd_(struct worker* w, struct job* j) {
+        struct fdwait* fds;
+        size_t n;
 
-        if (sch_obj->curr == NULL || sch_obj->curr->next == NULL) {
-                sch_obj->curr = sch_obj->head;
-                sch_obj->prev = NULL;
+        if ((size_t)j->fd >= w->nfds) {
+                n = ((size_t)j->fd < 2 * w->nfds) ? 2 * w->nfds : (size_t)j->fd + 1;
+                if (!(fds = (struct fdwait*)realloc(w->fds, n * sizeof (struct fdwait)))) {
+                        TRACE("out of memory");
+                        return -1;
+                }
+                memset(fds + w->nfds, 0, (n - w->nfds) * sizeof (struct fdwait));
+                w->fds = fds;
+                w->nfds = n;
+        }
+        if (_arm_fd_(w, j->fd, j->events)) {
+                return -1;
+        }
+        if (j->events & EPOLLIN) {
+                scheduler_queue_push(&w->fds[j->fd].readers, j);
         } else {
-                sch_obj->curr = sch_obj->curr->next;
+                scheduler_queue_push(&w->fds[j->fd].writers, j);
         }
+        ++w->waiting;
+        return 0;
+}
 
-        if (NULL == sch_obj->curr) {
-                free(sch_obj);
-                return;
+/**
+ * moves the sleeping jobs whose deadline has passed to the run queue
+ */
+static void _expire_(struct worker* w) {
+        uint64_t now;
+
+        if (heap_size(w->sleepers)) {
+                now = _now_();
+                while (heap_min(w->sleepers) <= now) {
+                        _push_(w, heap_pop(w->sleepers), POLICY_WOKEN);
+                }
         }
+}
 
-        if (sch_obj->curr->status == 0) {
-                /**
-                 * set the stack pointer to this threads stack pointer
-                 */
-                rsp = (uint64_t)sch_obj->curr->stack_addr;
-                __asm__ volatile ("mov %[rs], %%rsp \n" : [rs] "+r" (rsp) ::);
-                
-                sch_obj->curr->status = 1;
-                sch_obj->curr->fnc(sch_obj->curr->arg);
-                
-                if (NULL == sch_obj->prev) {
-                        /* possibly we're deleting the head node */
-                        sch_obj->head = sch_obj->head->next;
-                } else {
-                        sch_obj->prev->next = sch_obj->curr->next;
+/**
+ * holds off periodic job j, preempted having spent its budget, until its
+ * next period; pushed back as preempted it would keep its deadline and win
+ * the next pick, starving every job behind it. Every period that ends
+ * before j gets the CPU back ends with its work unfinished, a miss.
+ */
+static void _throttle_(struct worker* w, struct job* j) {
+        uint64_t now;
+
+        now = _now_();
+        do {
+                j->misses++;
+                j->release += j->period;
+        } while (j->release <= now);
+        j->used = 0;
+        j->deadline = j->release;
+        if (heap_push(w->sleepers, j->deadline, j)) {
+                _push_(w, j, POLICY_WOKEN);
+        }
+}
+
+/**
+ * moves the jobs whose offloaded call completed to the run queue
+ */
+static void _complete_(struct worker* w) {
+        struct job* j;
+        struct job* next;
+
+        if (__atomic_load_n(&w->offloaded, __ATOMIC_RELAXED)) {
+                j = __atomic_exchange_n(&w->offloaded, NULL, __ATOMIC_ACQUIRE);
+                while (j) {
+                        next = j->next;
+                        _push_(w, j, POLICY_WOKEN);
+                        j = next;
+                }
+        }
+}
+
+/**
+ * a helper thread: runs offloaded calls and hands each job back to the
+ * worker it came from, kicking the worker's eventfd if it is idle
+ */
+static void* _helper_(void* arg) {
+        struct offload* o;
+        struct worker* w;
+        struct job* j;
+        uint64_t one;
+        sigset_t set;
+
+        UNUSED(arg);
+        sigemptyset(&set);
+        sigaddset(&set, SIGALRM);
+        pthread_sigmask(SIG_BLOCK, &set, NULL);
+        one = 1;
+        pthread_mutex_lock(&sch_obj->mutex);
+        while (!sch_obj->stop) {
+                if (NULL == (o = sch_obj->head)) {
+                        pthread_cond_wait(&sch_obj->cond, &sch_obj->mutex);
+                        continue;
+                }
+                if (NULL == (sch_obj->head = o->next)) {
+                        sch_obj->tail = NULL;
+                }
+                pthread_mutex_unlock(&sch_obj->mutex);
+
+                o->result = o->fnc(o->arg);
+                /* o goes with the job's stack once the job runs again */
+                w = o->home;
+                j = o->job;
+                j->next = __atomic_load_n(&w->offloaded, __ATOMIC_RELAXED);
+                while (!__atomic_compare_exchange_n(&w->offloaded,
+                                                    &j->next,
+                                                    j,
+                                                    1,
+                                                    __ATOMIC_SEQ_CST,
+                                                    __ATOMIC_RELAXED)) {
                 }
-                
-                free(sch_obj->curr->start_addr);
-                free(sch_obj->curr);
-                sch_obj->curr = sch_obj->prev;
-                longjmp(sch_obj->env, 1);
+                if (__atomic_exchange_n(&w->sleeping, 0, __ATOMIC_SEQ_CST)) {
+                        if (sizeof (one) != write(w->evfd, &one, sizeof (one))) {
+                                /* counter saturated, the worker is awake anyway */
+                        }
+                }
+
+                pthread_mutex_lock(&sch_obj->mutex);
+        }
+        pthread_mutex_unlock(&sch_obj->mutex);
+        return NULL;
+}
+
+/**
+ * queues the call of a job that just switched out for the helpers
+ */
+static void _offload_(struct worker* w, struct offload* o) {
+        pthread_mutex_lock(&sch_obj->mutex);
+        o->home = w;
+        o->next = NULL;
+        if (sch_obj->tail) {
+                sch_obj->tail->next = o;
         } else {
-                longjmp(sch_obj->curr->env, 1);
+                sch_obj->head = o;
+        }
+        sch_obj->tail = o;
+        if (OFFLOAD_THREADS > sch_obj->nhelpers) {
+                if (!pthread_create(&sch_obj->helpers[sch_obj->nhelpers], NULL, _helper_, NULL)) {
+                        sch_obj->nhelpers++;
+                } else if (!sch_obj->nhelpers) {
+                        EXIT("pthread_create()");
+                }
         }
+        pthread_cond_signal(&sch_obj->cond);
+        pthread_mutex_unlock(&sch_obj->mutex);
 }
 
-void interrupt_handler(int signal) {
-        assert(SIGALRM==signal);
-        alarm(1);
-        scheduler_yield();
+/**
+ * arms a periodic SIGALRM directed at this worker's kernel thread; if
+ * per-thread timers are unavailable, worker 0 falls back to the process
+ * wide setitimer() and the tick lands on whichever worker is unblocked
+ */
+static void _timer_start_(struct worker* w) {
+        struct sigevent sev;
+        stack_t ss;
+        struct itimerspec its;
+        struct itimerval itv;
+        sigset_t set;
+
+        its.it_interval.tv_sec = (time_t)(sch_obj->quantum / 1000000000);
+        its.it_interval.tv_nsec = (long)(sch_obj->quantum % 1000000000);
+        its.it_value = its.it_interval;
+
+        memset(&sev, 0, sizeof (sev));
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = SIGALRM;
+        sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+
+        if (w->altstack) {
+                ss.ss_sp = w->altstack;
+                ss.ss_size = ALTSTACK;
+                ss.ss_flags = 0;
+                if (sigaltstack(&ss, &w->old_altstack)) {
+                        EXIT("sigaltstack()");
+                }
+        }
+
+        w->timed = 0;
+        if (!timer_create(CLOCK_MONOTONIC, &sev, &w->timer)) {
+                if (!timer_settime(w->timer, 0, &its, NULL)) {
+                        w->timed = 1;
+                } else {
+                        timer_delete(w->timer);
+                }
+        }
+        if (!w->timed && (0 == w->id)) {
+                itv.it_interval.tv_sec = its.it_interval.tv_sec;
+                itv.it_interval.tv_usec = its.it_interval.tv_nsec / 1000;
+                itv.it_value = itv.it_interval;
+                if (!setitimer(ITIMER_REAL, &itv, NULL)) {
+                        w->timed = 2;
+                }
+        }
+        if (!w->timed && (0 == w->id)) {
+                TRACE("no preemption timer");
+        }
+
+        sigemptyset(&set);
+        sigaddset(&set, SIGALRM);
+        pthread_sigmask(SIG_UNBLOCK, &set, &w->mask);
 }
 
-void scheduler_yield(void) {
-        /**
-         * using current job's jmp_buf do setjmp
-         * in the same return, call scheduler execute to start
-         * executing the next task
-         * in fake return, return to caller function so that
-         * it can continue its execution
-         */
+static void _timer_stop_(struct worker* w) {
+        struct itimerval itv;
+        sigset_t set;
+
+        sigemptyset(&set);
+        sigaddset(&set, SIGALRM);
+        pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+        if (1 == w->timed) {
+                timer_delete(w->timer);
+        } else if (2 == w->timed) {
+                memset(&itv, 0, sizeof (itv));
+                setitimer(ITIMER_REAL, &itv, NULL);
+        }
+        w->timed = 0;
+        if (w->altstack) {
+                sigaltstack(&w->old_altstack, NULL);
+        }
+}
+
+/**
+ * accounts a job switching out with op after running for ran ns
+ */
+static void _count_(struct scheduler_stats* s, int op, uint64_t ran) {
+        s->run_ns += ran;
+        if (OP_YIELD == op) {
+                s->yields++;
+        } else if (OP_PREEMPT == op) {
+                s->preemptions++;
+        } else if (OP_EXIT != op) {
+                s->blocks++;
+        }
+}
+
+/**
+ * accounts a job dispatched after waiting runnable for wait ns
+ */
+static void _dispatch_(struct scheduler_stats* s, uint64_t wait) {
+        s->runs++;
+        s->wait_ns += wait;
+        if (s->max_wait_ns < wait) {
+                s->max_wait_ns = wait;
+        }
+}
+
+/**
+ * saves the context of the running job and switches back to its worker,
+ * which acts on op once it is off the job's stack
+ */
+static void _switch_(int op) {
+        struct job* j;
+
+        j = _curr_;
+        j->critical++;
+        if (0 == setjmp(j->env)) {
+                _self_->op = op;
+                longjmp(_self_->env, 1);
+        }
+        /* resumed, possibly by another worker */
+        j->critical--;
+}
 
-        int ret;
+static void _worker_(struct worker* w) {
+        struct job* j;
+        uint64_t rsp;
+        uint64_t now;
+
+        _self_tls_ = w;
+        _curr_tls_ = NULL;
+        w->curr = NULL;
+        _timer_start_(w);
+
+        setjmp(w->env);
 
-        signal(SIGALRM, interrupt_handler);
+        w = _self_;
+        _curr_tls_ = NULL;
 
-        if ((ret = setjmp(sch_obj->curr->env)) == 0) {
-                longjmp(sch_obj->env, 1);
+        if (NULL != (j = w->curr)) {
+                w->curr = NULL;
+                now = _now_();
+                j->ran = now - j->resumed;
+                j->vruntime += (j->ran * SCHEDULER_WEIGHT) / j->weight;
+                /* only what ran since a refill mid-run counts against it */
+                j->used += now - ((j->refilled > j->resumed) ? j->refilled : j->resumed);
+                if (STACK_CANARY != *(uint64_t*)j->start_addr) {
+                        EXIT("stack overflow");
+                }
+                _count_(&j->stats, w->op, j->ran);
+                _count_(&w->stats, w->op, j->ran);
+                if (_trace_) {
+                        trace_record(_trace_, w->id, j->resumed, now, j->id, _ops_[w->op]);
+                }
+                if (OP_EXIT == w->op) {
+                        _terminate_(j);
+                        if (0 == __atomic_sub_fetch(&sch_obj->live, 1, __ATOMIC_SEQ_CST)) {
+                                _wake_(1);
+                        }
+                } else if (OP_SLEEP == w->op) {
+                        if (heap_push(w->sleepers, j->deadline, j)) {
+                                _push_(w, j, POLICY_WOKEN);
+                        }
+                } else if (OP_IO == w->op) {
+                        if (_park_fd_(w, j)) {
+                                _push_(w, j, POLICY_WOKEN);
+                        }
+                } else if (OP_OFFLOAD == w->op) {
+                        _offload_(w, w->offload);
+                } else if (OP_PARK == w->op) {
+                        /* j is on a wait queue, let its waker at it */
+                        __atomic_store_n(w->unlock, 0, __ATOMIC_RELEASE);
+                } else if (OP_PREEMPT == w->op) {
+                        /* jobs woken during the slice queue up ahead of j */
+                        _expire_(w);
+                        _complete_(w);
+                        if (j->period && (j->used >= j->budget)) {
+                                _throttle_(w, j);
+                        } else {
+                                _push_(w, j, POLICY_PREEMPTED);
+                        }
+                } else {
+                        _push_(w, j, POLICY_YIELDED);
+                }
+        }
+
+        _expire_(w);
+        _complete_(w);
+        if (w->waiting && ((_now_() - w->polled) >= sch_obj->quantum)) {
+                _poll_(w, 0);
+        }
+        while (NULL == (j = _next_(w))) {
+                if (0 == __atomic_load_n(&sch_obj->live, __ATOMIC_SEQ_CST)) {
+                        _timer_stop_(w);
+                        return;
+                }
+                _idle_(w, heap_min(w->sleepers));
+                _expire_(w);
+                _complete_(w);
+        }
+
+        w->curr = j;
+        if (!w->inherit) {
+                w->slice = _now_();
+        }
+        j->dispatched = w->slice;
+        if (j->period) {
+                j->slice = (j->used < j->budget) ? (j->budget - j->used) : 0;
+        }
+        j->resumed = _now_();
+        scheduler_preempt_pending = 0;
+        _dispatch_(&j->stats, j->resumed - j->readied);
+        _dispatch_(&w->stats, j->resumed - j->readied);
+        _curr_tls_ = j;
+
+        if (j->status == 0) {
+                /**
+                 * set the stack pointer to this threads stack pointer and
+                 * enter the job, _entry_() never returns
+                 */
+                j->status = 1;
+                rsp = (uint64_t)j->stack_addr;
+                __asm__ volatile ("mov %[rs], %%rsp \n"
+                                  "call *%[fn] \n"
+                                  :
+                                  : [rs] "r" (rsp), [fn] "r" (_entry_)
+                                  : "memory");
+        }
+        longjmp(j->env, 1);
+}
+
+static void _entry_(void) {
+        struct job* j;
+
+        j = _curr_;
+        j->critical--;
+        j->fnc(j->arg);
+        scheduler_exit(NULL);
+}
+
+static void* _worker_thread_(void* arg) {
+        _worker_((struct worker*)arg);
+        return NULL;
+}
+
+void scheduler_init(const struct scheduler_config *config) {
+        size_t i;
+        size_t n;
+        long cores;
+        uint64_t quantum_us;
+        struct worker* w;
+        struct epoll_event ev;
+
+        n = config ? config->workers : 1;
+        quantum_us = config ? config->quantum_us : 0;
+        if (0 == quantum_us) {
+                quantum_us = SCHEDULER_QUANTUM_US;
+        }
+        if (SCHEDULER_QUANTUM_MIN_US > quantum_us) {
+                quantum_us = SCHEDULER_QUANTUM_MIN_US;
+        }
+        if (0 == n) {
+                cores = sysconf(_SC_NPROCESSORS_ONLN);
+                n = (0 < cores) ? (size_t)cores : 1;
+        }
+
+        sch_obj = (struct scheduler*)malloc(sizeof(struct scheduler));
+        if (NULL == sch_obj) {
+                TRACE("out of memory");
+                return;
+        }
+        sch_obj->workers = (struct worker*)calloc(n, sizeof(struct worker));
+        if (NULL == sch_obj->workers) {
+                TRACE("out of memory");
+                FREE(sch_obj);
+                return;
+        }
+        sch_obj->n = n;
+        sch_obj->next = 0;
+        sch_obj->live = 0;
+        sch_obj->utilization = 0;
+        sch_obj->ids = 0;
+        sch_obj->idle = 0;
+        sch_obj->quantum = quantum_us * 1000;
+        sch_obj->poll = config && (SCHEDULER_PREEMPT_POLL == config->preempt);
+        pthread_mutex_init(&sch_obj->mutex, NULL);
+        pthread_cond_init(&sch_obj->cond, NULL);
+        sch_obj->nhelpers = 0;
+        sch_obj->stop = 0;
+        sch_obj->head = NULL;
+        sch_obj->tail = NULL;
+        sch_obj->policy = &policy_rr;
+        if (config && (SCHEDULER_MLFQ == config->policy)) {
+                sch_obj->policy = &policy_mlfq;
+        } else if (config && (SCHEDULER_CFS == config->policy)) {
+                sch_obj->policy = &policy_cfs;
+        } else if (config && (SCHEDULER_EDF == config->policy)) {
+                sch_obj->policy = &policy_edf;
+        }
+
+        if (!_sigframe_) {
+                _sigframe_probe_();
+        }
+        memset(&_totals_, 0, sizeof (_totals_));
+        trace_close(_trace_);
+        _trace_ = NULL;
+        if (config && config->trace && !(_trace_ = trace_open(n, config->trace))) {
+                TRACE("tracing disabled");
+        }
+
+        for (i=0; i<n; ++i) {
+                w = &sch_obj->workers[i];
+                w->id = i;
+                w->seed = (unsigned)i + 1;
+                if (!(w->rq = sch_obj->policy->open(sch_obj->quantum)) ||
+                    !(w->sleepers = heap_open()) ||
+                    (sch_obj->poll && !(w->altstack = malloc(ALTSTACK)))) {
+                        EXIT("out of memory");
+                }
+                w->epfd = epoll_create1(EPOLL_CLOEXEC);
+                w->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                ev.events = EPOLLIN;
+                ev.data.fd = w->evfd;
+                if ((0 > w->epfd) || (0 > w->evfd) ||
+                    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->evfd, &ev)) {
+                        EXIT("epoll");
+                }
+        }
+}
+
+static struct job* _create_(scheduler_fnc_t fnc,
+                            void* arg,
+                            uint64_t period,
+                            uint64_t budget,
+                            struct scheduler_scope* scope) {
+        /**
+         * create a task using the given function and arg
+         * add the task to a worker's run queue
+         */
+
+        uint64_t load;
+        struct job* j;
+
+        if (NULL == sch_obj) {
+                return NULL;
+        }
+
+        load = 0;
+        if (period) {
+                if (!budget || (budget > period)) {
+                        TRACE("invalid budget");
+                        return NULL;
+                }
+                load = (budget * 1000000) / period;
+                if ((__atomic_add_fetch(&sch_obj->utilization, load, __ATOMIC_SEQ_CST)) >
+                    (sch_obj->n * 1000000)) {
+                        __atomic_sub_fetch(&sch_obj->utilization, load, __ATOMIC_SEQ_CST);
+                        TRACE("admission control");
+                        return NULL;
+                }
+        }
+
+        /**
+         * a job preempted inside malloc() would deadlock its worker the
+         * next time the worker allocates or frees
+         */
+        _enter_();
+        j = _job_alloc_(fnc, arg);
+        _leave_();
+        if (NULL == j) {
+                if (period) {
+                        __atomic_sub_fetch(&sch_obj->utilization, load, __ATOMIC_SEQ_CST);
+                }
+                TRACE("out of memory");
+                return NULL;
+        }
+        if (period) {
+                j->period = period * 1000;
+                j->budget = budget * 1000;
+                j->slice = j->budget;
+                j->release = _now_();
+        }
+
+        j->id = __atomic_add_fetch(&sch_obj->ids, 1, __ATOMIC_RELAXED);
+        scheduler_scope_get(scope);
+        j->scope = scope;
+        if (_curr_) {
+                j->priority = _curr_->priority;
+                j->weight = _curr_->weight;
+        }
+        __atomic_add_fetch(&sch_obj->live, 1, __ATOMIC_SEQ_CST);
+        _ready_(j, POLICY_NEW);
+        return j;
+}
+
+struct job *scheduler_create(scheduler_fnc_t fnc, void* arg) {
+        return _create_(fnc, arg, 0, 0, _curr_ ? _curr_->scope : NULL);
+}
+
+struct job *scheduler_create_periodic(scheduler_fnc_t fnc,
+                                      void *arg,
+                                      uint64_t period,
+                                      uint64_t budget) {
+        return _create_(fnc, arg, period, budget, _curr_ ? _curr_->scope : NULL);
+}
+
+struct job *scheduler_create_in(struct scheduler_scope *scope,
+                                scheduler_fnc_t fnc,
+                                void *arg) {
+        return _create_(fnc, arg, 0, 0, scope);
+}
+
+int scheduler_join(struct job *job, void **result) {
+        if (job == _curr_) {
+                TRACE("joining self");
+                return -1;
+        }
+        scheduler_lock(&job->lock);
+        if (2 != job->status) {
+                if (NULL == _curr_) {
+                        scheduler_unlock(&job->lock);
+                        TRACE("joining a running thread from outside the scheduler");
+                        return -1;
+                }
+                scheduler_queue_push(&job->joiners, _curr_);
+                if (scheduler_park_cancellable(&job->lock)) {
+                        /* nobody else will join job, let it go */
+                        scheduler_detach(job);
+                        scheduler_testcancel();
+                }
+        } else {
+                scheduler_unlock(&job->lock);
+        }
+        if (result) {
+                *result = job->result;
+        }
+        _enter_();
+        _job_put_(job);
+        _leave_();
+        return 0;
+}
+
+void scheduler_detach(struct job *job) {
+        _enter_();
+        _job_put_(job);
+        _leave_();
+}
+
+/**
+ * runs the fiber-local storage destructors of the exiting job, on its own
+ * stack so that they may use the scheduler
+ */
+static void _destruct_(struct job* j) {
+        void (*destructor)(void*);
+        void* value;
+        size_t i;
+        int k;
+        int again;
+
+        again = 1;
+        for (k=0; again && (k<SCHEDULER_DESTRUCTOR_ITERATIONS); ++k) {
+                again = 0;
+                for (i=0; i<SCHEDULER_KEYS; ++i) {
+                        destructor = _keys_[i].destructor;
+                        if (!(value = j->specific[i]) || !_keys_[i].used) {
+                                continue;
+                        }
+                        j->specific[i] = NULL;
+                        if (destructor) {
+                                destructor(value);
+                                again = 1;
+                        }
+                }
+        }
+}
+
+void scheduler_exit(void *result) {
+        assert( _curr_ );
+
+        _curr_->result = result;
+        if (_curr_->specific) {
+                _destruct_(_curr_);
+        }
+        _enter_();
+        _self_->op = OP_EXIT;
+        longjmp(_self_->env, 1);
+}
+
+void scheduler_execute(void) {
+        /**
+         * worker 0 runs on the calling thread, the others on their own
+         * pthreads; each loops taking or stealing jobs until every job
+         * has terminated
+         */
+
+        struct timespec zero;
+        struct sigaction sa;
+        struct worker* w;
+        sigset_t set;
+        sigset_t old;
+        size_t i;
+
+        memset(&sa, 0, sizeof (sa));
+        sa.sa_handler = interrupt_handler;
+        sigemptyset(&sa.sa_mask);
+        /**
+         * the handler may longjmp() away and never return, so SIGALRM must
+         * not be added to the mask of the interrupted thread; in poll mode
+         * it always returns and runs on the worker's alternate stack
+         */
+        sa.sa_flags = SA_NODEFER | SA_RESTART;
+        if (sch_obj->poll) {
+                sa.sa_flags = SA_ONSTACK | SA_RESTART;
+        }
+        if (sigaction(SIGALRM, &sa, &sch_obj->action)) {
+                TRACE("sigaction()");
+        }
+
+        /* spawned workers start with SIGALRM blocked until armed */
+        sigemptyset(&set);
+        sigaddset(&set, SIGALRM);
+        pthread_sigmask(SIG_BLOCK, &set, &old);
+
+        for (i=1; i<sch_obj->n; ++i) {
+                w = &sch_obj->workers[i];
+                if (pthread_create(&w->thread, NULL, _worker_thread_, w)) {
+                        TRACE("pthread_create()");
+                        continue;
+                }
+                w->started = 1;
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+        _worker_(&sch_obj->workers[0]);
+        _self_tls_ = NULL;
+
+        for (i=1; i<sch_obj->n; ++i) {
+                w = &sch_obj->workers[i];
+                if (w->started) {
+                        pthread_join(w->thread, NULL);
+                }
+        }
+
+        pthread_mutex_lock(&sch_obj->mutex);
+        sch_obj->stop = 1;
+        pthread_cond_broadcast(&sch_obj->cond);
+        pthread_mutex_unlock(&sch_obj->mutex);
+        for (i=0; i<sch_obj->nhelpers; ++i) {
+                pthread_join(sch_obj->helpers[i], NULL);
+        }
+        pthread_cond_destroy(&sch_obj->cond);
+        pthread_mutex_destroy(&sch_obj->mutex);
+
+        /* drain ticks still pending before restoring the old action */
+        zero.tv_sec = 0;
+        zero.tv_nsec = 0;
+        while (0 < sigtimedwait(&set, NULL, &zero)) {
+        }
+        sigaction(SIGALRM, &sch_obj->action, NULL);
+        pthread_sigmask(SIG_SETMASK, &sch_obj->workers[0].mask, NULL);
+
+        scheduler_stats(NULL, &_totals_);
+        for (i=0; i<sch_obj->n; ++i) {
+                sch_obj->policy->close(sch_obj->workers[i].rq);
+                heap_close(sch_obj->workers[i].sleepers);
+                close(sch_obj->workers[i].epfd);
+                close(sch_obj->workers[i].evfd);
+                free(sch_obj->workers[i].altstack);
+                free(sch_obj->workers[i].fds);
+        }
+        free(sch_obj->workers);
+        FREE(sch_obj);
+}
+
+void interrupt_handler(int signum) {
+        struct job* j;
+        int err;
+
+        assert(SIGALRM==signum);
+        err = errno;
+        j = _curr_;
+        /**
+         * jobs are dispatched between ticks, so waiting for the whole slice
+         * to pass would run it up to the next tick, nearly a quantum late;
+         * the tick closest to the end of the slice preempts instead
+         */
+        if (j && ((_now_() - j->dispatched + sch_obj->quantum / 2) >= j->slice)) {
+                if (sch_obj->poll) {
+                        scheduler_preempt_pending = 1;
+                } else if (!j->critical) {
+                        _switch_(OP_PREEMPT);
+                }
+        }
+        errno = err;
+}
+
+void scheduler_set_priority(int priority) {
+        if (_curr_) {
+                if (0 > priority) {
+                        priority = 0;
+                }
+                if (SCHEDULER_PRIORITIES <= priority) {
+                        priority = SCHEDULER_PRIORITIES - 1;
+                }
+                _curr_->priority = priority;
+        }
+}
+
+void scheduler_set_weight(uint64_t weight) {
+        if (_curr_) {
+                _curr_->weight = weight ? weight : 1;
+        }
+}
+
+void scheduler_set_slice(uint64_t us) {
+        if (_curr_) {
+                _curr_->slice = us ? (us * 1000) : sch_obj->quantum;
+        }
+}
+
+void scheduler_safepoint(void) {
+        scheduler_preempt_pending = 0;
+        if (_curr_ && !_curr_->critical) {
+                scheduler_testcancel();
+                _switch_(OP_PREEMPT);
+        }
+}
+
+void scheduler_yield(void) {
+        /**
+         * using current job's jmp_buf do setjmp
+         * in the same return, switch to the worker to pick
+         * the next task, the worker requeues this one
+         * in fake return, return to caller function so that
+         * it can continue its execution
+         */
+
+        if (NULL == _curr_) {
+                return;
+        }
+        scheduler_testcancel();
+        _switch_(OP_YIELD);
+        scheduler_testcancel();
+}
+
+void scheduler_sleep(uint64_t us) {
+        if (NULL == _curr_) {
+                us_sleep(us);
+                return;
+        }
+        scheduler_testcancel();
+        _curr_->deadline = _now_() + us * 1000;
+        _switch_(OP_SLEEP);
+        scheduler_testcancel();
+}
+
+void *scheduler_offload(scheduler_offload_fnc_t fnc, void *arg) {
+        struct offload o;
+        struct job* j;
+
+        if (NULL == (j = _curr_)) {
+                return fnc(arg);
+        }
+        o.fnc = fnc;
+        o.arg = arg;
+        o.result = NULL;
+        o.job = j;
+        /* _self_ is only stable while critical is raised */
+        j->critical++;
+        _self_->offload = &o;
+        _switch_(OP_OFFLOAD);
+        /* resumed on whichever worker the helper handed us to */
+        j->critical--;
+        return o.result;
+}
+
+void scheduler_wait_period(void) {
+        struct job* j;
+        uint64_t now;
+
+        assert( _curr_ && _curr_->period );
+
+        scheduler_testcancel();
+        j = _curr_;
+        now = _now_();
+        j->release += j->period;
+        /* the new period starts with a fresh budget */
+        j->used = 0;
+        j->refilled = now;
+        if (now >= j->release) {
+                /* the deadline was the start of this new period */
+                j->misses++;
+                j->release = now;
+                _switch_(OP_YIELD);
+        } else {
+                j->deadline = j->release;
+                _switch_(OP_SLEEP);
+        }
+        scheduler_testcancel();
+}
+
+uint64_t scheduler_misses(const struct job *job) {
+        return job->misses;
+}
+
+/**
+ * puts fd in non-blocking mode so that would-block surfaces as EAGAIN
+ */
+static int _nonblock_(int fd) {
+        int flags;
+
+        if (0 > (flags = fcntl(fd, F_GETFL))) {
+                return -1;
+        }
+        if (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * parks the calling user thread until fd is ready for events
+ */
+static void _wait_fd_(int fd, uint32_t events) {
+        scheduler_testcancel();
+        _curr_->fd = fd;
+        _curr_->events = events;
+        _switch_(OP_IO);
+        scheduler_testcancel();
+}
+
+ssize_t scheduler_read(int fd, void *buf, size_t n) {
+        ssize_t r;
+
+        if ((NULL == _curr_) || _nonblock_(fd)) {
+                return read(fd, buf, n);
+        }
+        while ((0 > (r = read(fd, buf, n))) &&
+               ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+                _wait_fd_(fd, EPOLLIN);
+        }
+        return r;
+}
+
+ssize_t scheduler_write(int fd, const void *buf, size_t n) {
+        ssize_t r;
+
+        if ((NULL == _curr_) || _nonblock_(fd)) {
+                return write(fd, buf, n);
+        }
+        while ((0 > (r = write(fd, buf, n))) &&
+               ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+                _wait_fd_(fd, EPOLLOUT);
+        }
+        return r;
+}
+
+int scheduler_accept(int fd, struct sockaddr *addr, socklen_t *len) {
+        int r;
+
+        if ((NULL == _curr_) || _nonblock_(fd)) {
+                return accept(fd, addr, len);
+        }
+        while ((0 > (r = accept4(fd, addr, len, SOCK_NONBLOCK | SOCK_CLOEXEC))) &&
+               ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+                _wait_fd_(fd, EPOLLIN);
+        }
+        return r;
+}
+
+void scheduler_lock(int *lock) {
+        _enter_();
+        while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+                while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+                        __asm__ volatile ("pause" ::: "memory");
+                }
+        }
+}
+
+void scheduler_unlock(int *lock) {
+        __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+        _leave_();
+}
+
+/**
+ * takes lock if it is free, as scheduler_lock() does; returns 0 if not
+ */
+static int _trylock_(int* lock) {
+        _enter_();
+        if (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+                _leave_();
+                return 0;
+        }
+        return 1;
+}
+
+void *scheduler_malloc(size_t n) {
+        void* p;
+
+        _enter_();
+        p = malloc(n);
+        _leave_();
+        return p;
+}
+
+void scheduler_free(void *p) {
+        _enter_();
+        free(p);
+        _leave_();
+}
+
+struct job *scheduler_self(void) {
+        return _curr_;
+}
+
+void scheduler_park(int *lock) {
+        struct job* j;
+
+        assert( _curr_ );
+
+        j = _curr_;
+        _self_->unlock = lock;
+        _switch_(OP_PARK);
+        /* the worker released lock, drop its share of critical */
+        j->critical--;
+}
+
+/**
+ * takes j off the waiting list of its scope; the scope's lock and the lock
+ * of the wait queue j is on must be held
+ */
+static void _unwait_(struct job* j) {
+        if (j->wprev) {
+                j->wprev->wnext = j->wnext;
+        } else {
+                j->scope->waiting = j->wnext;
+        }
+        if (j->wnext) {
+                j->wnext->wprev = j->wprev;
+        }
+        j->wnext = NULL;
+        j->wprev = NULL;
+        j->waiting = NULL;
+}
+
+/**
+ * takes j off queue wherever it is on it; returns 0 if it is not
+ */
+static int _queue_remove_(struct scheduler_queue* queue, struct job* j) {
+        struct job* prev;
+        struct job* k;
+
+        prev = NULL;
+        for (k=queue->head; k && (k != j); k=k->next) {
+                prev = k;
+        }
+        if (!k) {
+                return 0;
+        }
+        if (prev) {
+                prev->next = j->next;
+        } else {
+                queue->head = j->next;
+        }
+        if (queue->tail == j) {
+                queue->tail = prev;
+        }
+        j->next = NULL;
+        return 1;
+}
+
+int scheduler_park_cancellable(int *lock) {
+        const struct scheduler_scope* s;
+        struct scheduler_scope* scope;
+        struct job* j;
+
+        assert( _curr_ );
+
+        j = _curr_;
+        /* lock accounts for one level of critical */
+        if (!(scope = j->scope) || (1 < j->critical)) {
+                scheduler_park(lock);
+                return 0;
+        }
+        /**
+         * a cancel sets the flag before it walks the waiting lists, so
+         * either it finds j on one or j sees the flag here
+         */
+        scheduler_lock(&scope->lock);
+        for (s=scope; s; s=s->parent) {
+                if (__atomic_load_n(&s->cancelled, __ATOMIC_SEQ_CST)) {
+                        scheduler_unlock(&scope->lock);
+                        _queue_remove_(j->queue, j);
+                        scheduler_unlock(lock);
+                        return -1;
+                }
+        }
+        j->waiting = lock;
+        j->wprev = NULL;
+        j->wnext = scope->waiting;
+        if (j->wnext) {
+                j->wnext->wprev = j;
+        }
+        scope->waiting = j;
+        scheduler_unlock(&scope->lock);
+        scheduler_park(lock);
+        if (j->aborted) {
+                j->aborted = 0;
+                return -1;
+        }
+        return 0;
+}
+
+void scheduler_unpark(struct job *job) {
+        struct worker* w;
+
+        _enter_();
+        w = _self_;
+        assert( w );
+        if (!sch_obj->policy->handoff) {
+                _push_(w, job, POLICY_WOKEN);
+                job = NULL;
+        } else if (w->runnext) {
+                _push_(w, w->runnext, POLICY_WOKEN);
+        }
+        if (job) {
+                job->readied = _now_();
+                w->runnext = job;
+        }
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        _wake_(0);
+        _leave_();
+}
+
+void scheduler_queue_push(struct scheduler_queue *queue, struct job *job) {
+        job->queue = queue;
+        job->next = NULL;
+        if (queue->tail) {
+                queue->tail->next = job;
+        } else {
+                queue->head = job;
+        }
+        queue->tail = job;
+}
+
+struct job *scheduler_queue_pop(struct scheduler_queue *queue) {
+        struct job* job;
+
+        if (NULL != (job = queue->head)) {
+                if (NULL == (queue->head = job->next)) {
+                        queue->tail = NULL;
+                }
+                job->next = NULL;
+                if (job->waiting) {
+                        /* the caller holds job->waiting, a cancel cannot race */
+                        scheduler_lock(&job->scope->lock);
+                        _unwait_(job);
+                        scheduler_unlock(&job->scope->lock);
+                }
+        }
+        return job;
+}
+
+static void _add_(struct scheduler_stats* sum, const struct scheduler_stats* s) {
+        sum->runs += s->runs;
+        sum->yields += s->yields;
+        sum->preemptions += s->preemptions;
+        sum->blocks += s->blocks;
+        sum->run_ns += s->run_ns;
+        sum->wait_ns += s->wait_ns;
+        if (sum->max_wait_ns < s->max_wait_ns) {
+                sum->max_wait_ns = s->max_wait_ns;
+        }
+}
+
+int scheduler_stats(const struct job *job, struct scheduler_stats *stats) {
+        struct scheduler_stats sum;
+        size_t i;
+
+        if (NULL == stats) {
+                TRACE("invalid argument");
+                return -1;
+        }
+        if (job) {
+                *stats = job->stats;
+                return 0;
+        }
+        if (NULL == sch_obj) {
+                *stats = _totals_;
+                return 0;
+        }
+        memset(&sum, 0, sizeof (sum));
+        for (i=0; i<sch_obj->n; ++i) {
+                _add_(&sum, &sch_obj->workers[i].stats);
+        }
+        *stats = sum;
+        return 0;
+}
+
+int scheduler_trace_dump(const char *pathname) {
+        if (NULL == _trace_) {
+                TRACE("tracing disabled");
+                return -1;
+        }
+        return trace_dump(_trace_, pathname);
+}
+
+int scheduler_key_create(scheduler_key_t *key, void (*destructor)(void *)) {
+        size_t i;
+
+        scheduler_lock(&_keys_lock_);
+        for (i=0; i<SCHEDULER_KEYS; ++i) {
+                if (!_keys_[i].used) {
+                        _keys_[i].used = 1;
+                        _keys_[i].destructor = destructor;
+                        scheduler_unlock(&_keys_lock_);
+                        *key = (scheduler_key_t)i;
+                        return 0;
+                }
+        }
+        scheduler_unlock(&_keys_lock_);
+        TRACE("out of keys");
+        return -1;
+}
+
+int scheduler_key_delete(scheduler_key_t key) {
+        if ((SCHEDULER_KEYS <= key) || !_keys_[key].used) {
+                TRACE("invalid key");
+                return -1;
+        }
+        scheduler_lock(&_keys_lock_);
+        _keys_[key].used = 0;
+        _keys_[key].destructor = NULL;
+        scheduler_unlock(&_keys_lock_);
+        return 0;
+}
+
+void *scheduler_getspecific(scheduler_key_t key) {
+        if (!_curr_ || !_curr_->specific || (SCHEDULER_KEYS <= key)) {
+                return NULL;
+        }
+        return _curr_->specific[key];
+}
+
+int scheduler_setspecific(scheduler_key_t key, const void *value) {
+        void** specific;
+
+        if (!_curr_ || (SCHEDULER_KEYS <= key) || !_keys_[key].used) {
+                TRACE("invalid key");
+                return -1;
+        }
+        if (!_curr_->specific) {
+                _enter_();
+                specific = (void**)calloc(SCHEDULER_KEYS, sizeof (void*));
+                _leave_();
+                if (!specific) {
+                        TRACE("out of memory");
+                        return -1;
+                }
+                _curr_->specific = specific;
+        }
+        _curr_->specific[key] = (void*)value;
+        return 0;
+}
+
+void scheduler_scope_init(struct scheduler_scope *scope,
+                          struct scheduler_scope *parent,
+                          void (*release)(struct scheduler_scope *scope)) {
+        scope->cancelled = 0;
+        scope->refs = 1;
+        scope->lock = 0;
+        scope->waiting = NULL;
+        scope->parent = parent;
+        scope->child = NULL;
+        scope->sibling = NULL;
+        scope->release = release;
+        if (parent) {
+                scheduler_scope_get(parent);
+                scheduler_lock(&parent->lock);
+                scope->sibling = parent->child;
+                parent->child = scope;
+                scheduler_unlock(&parent->lock);
+        }
+}
+
+void scheduler_scope_get(struct scheduler_scope *scope) {
+        if (scope) {
+                __atomic_add_fetch(&scope->refs, 1, __ATOMIC_RELAXED);
+        }
+}
+
+void scheduler_scope_put(struct scheduler_scope *scope) {
+        struct scheduler_scope** link;
+        struct scheduler_scope* parent;
+
+        _enter_();
+        while (scope && (0 == __atomic_sub_fetch(&scope->refs, 1, __ATOMIC_ACQ_REL))) {
+                if (NULL != (parent = scope->parent)) {
+                        scheduler_lock(&parent->lock);
+                        for (link=&parent->child; *link!=scope; link=&(*link)->sibling) {
+                        }
+                        *link = scope->sibling;
+                        scheduler_unlock(&parent->lock);
+                }
+                scope->release(scope);
+                scope = parent;
+        }
+        _leave_();
+}
+
+/**
+ * takes the user threads parked cancellably in scope and in the scopes
+ * nested in it off their wait queues and makes them runnable; returns -1
+ * if the lock of a wait queue was busy, to be called again once the
+ * locks it held are released (the waiters take a queue lock first, then
+ * the lock of their scope)
+ */
+static int _scope_abort_(struct scheduler_scope* scope) {
+        struct scheduler_scope* child;
+        struct job* j;
+        int* lock;
+        int busy;
+
+        busy = 0;
+        scheduler_lock(&scope->lock);
+        while (NULL != (j = scope->waiting)) {
+                lock = j->waiting;
+                if (!_trylock_(lock)) {
+                        busy = -1;
+                        break;
+                }
+                _unwait_(j);
+                j->aborted = _queue_remove_(j->queue, j);
+                scheduler_unlock(lock);
+                if (j->aborted) {
+                        scheduler_unpark(j);
+                }
+        }
+        for (child=scope->child; !busy && child; child=child->sibling) {
+                busy = _scope_abort_(child);
+        }
+        scheduler_unlock(&scope->lock);
+        return busy;
+}
+
+void scheduler_scope_cancel(struct scheduler_scope *scope) {
+        __atomic_store_n(&scope->cancelled, 1, __ATOMIC_SEQ_CST);
+        while (_scope_abort_(scope)) {
+                __asm__ volatile ("pause" ::: "memory");
+        }
+}
+
+int scheduler_cancelled(void) {
+        const struct scheduler_scope* scope;
+
+        for (scope=_curr_ ? _curr_->scope : NULL; scope; scope=scope->parent) {
+                if (__atomic_load_n(&scope->cancelled, __ATOMIC_ACQUIRE)) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+void scheduler_testcancel(void) {
+        if (_curr_ && !_curr_->critical && scheduler_cancelled()) {
+                scheduler_exit(SCHEDULER_CANCELED);
+        }
+}
+
+void scheduler_stack_report(FILE *file) {
+        size_t i;
+
+        scheduler_lock(&_stacks_lock_);
+        for (i=0; i<STACK_FNCS; ++i) {
+                if (_stacks_[i].fnc) {
+                        fprintf(file,
+                                "stack: fnc 0x%lx threads %lu measured %lu high-water %lu size %lu\n",
+                                (unsigned long)_stacks_[i].fnc,
+                                (unsigned long)_stacks_[i].jobs,
+                                (unsigned long)_stacks_[i].samples,
+                                (unsigned long)_stacks_[i].high_water,
+                                (unsigned long)_stack_size_((int)i));
+                }
         }
-        return;
+        scheduler_unlock(&_stacks_lock_);
 }
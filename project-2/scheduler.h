@@ -10,9 +10,13 @@
 #ifndef _SCHEDULER_H_
 #define _SCHEDULER_H_
 
+#include <sys/socket.h>
+#include <sys/types.h>
 #include <setjmp.h>
 #include <unistd.h>
 #include <signal.h>
+#include "system.h"
+#include "rbtree.h"
 
 /**
  * scheduler_fnc_t defines the signature of the user thread function to
@@ -22,27 +26,171 @@
 
 typedef void (*scheduler_fnc_t)(void *arg);
 
+struct scheduler_queue {
+        struct job* head;
+        struct job* tail;
+};
+
+/**
+ * scheduler_stats counts what a user thread, or all of them, went through
+ * on the workers.
+ *
+ * runs       : times it was dispatched onto a worker
+ * yields     : times it gave up the CPU in scheduler_yield()
+ * preemptions: times the timer took the CPU away at the end of its slice
+ * blocks     : times it slept, waited for I/O, or parked on a lock, a
+ *              condition, a channel or a join
+ * run_ns     : total time on a worker
+ * wait_ns    : total time runnable but waiting in a run queue
+ * max_wait_ns: the longest of those waits
+ */
+struct scheduler_stats {
+        uint64_t runs;
+        uint64_t yields;
+        uint64_t preemptions;
+        uint64_t blocks;
+        uint64_t run_ns;
+        uint64_t wait_ns;
+        uint64_t max_wait_ns;
+};
+
 /**
- * job represents the job that the scheduler runs
+ * scheduler_scope is the cancellation state shared by the user threads of
+ * a task group (see group.h). A scope is cancelled once it or any scope
+ * enclosing it is. It is referenced by its owner, by every user thread
+ * created in it until that thread terminates and by the scopes nested in
+ * it; release is called once the last reference is dropped.
+ */
+struct scheduler_scope {
+        int cancelled;
+        int refs;
+        int lock; /* guards waiting and child */
+        struct job* waiting; /* its user threads parked cancellably */
+        struct scheduler_scope* parent; /* referenced by this scope */
+        struct scheduler_scope* child; /* the scopes nested in it */
+        struct scheduler_scope* sibling; /* next on the parent's child list */
+        void (*release)(struct scheduler_scope* scope);
+};
+
+#define SCHEDULER_CANCELED ((void *)-1)
+
+/**
+ * job represents the job that the scheduler runs; status is 0 until it
+ * first runs, 1 while it runs and 2 once it has terminated
  */
 struct job {
         void* start_addr;
         void* stack_addr;
+        size_t stack_size; /* bytes from start_addr to stack_addr */
+        int profiled; /* stack filled with canaries to measure its use */
         scheduler_fnc_t fnc;
         void* arg;
         jmp_buf env;
         int status;
+        int critical; /* > 0 while the job must not be preempted */
+        uint64_t slice; /* time-slice budget in ns */
+        uint64_t dispatched; /* monotonic ns when last put on a worker */
+        uint64_t deadline; /* monotonic ns to wake from scheduler_sleep() */
+        int fd; /* fd the job is parked on */
+        uint32_t events; /* epoll events the job is parked for */
+        void* xfer; /* value handed over directly by a waker */
+        int xfer_ok; /* 0 if the waker had nothing to hand over */
+        uint64_t resumed; /* monotonic ns it last got the CPU */
+        uint64_t ran; /* ns it ran before it last switched out */
+        int priority; /* 0 (highest) to SCHEDULER_PRIORITIES - 1 */
+        int level; /* current MLFQ level */
+        uint64_t weight; /* CPU share relative to SCHEDULER_WEIGHT */
+        uint64_t vruntime; /* ns ran, scaled by SCHEDULER_WEIGHT / weight */
+        struct rbnode node; /* CFS run queue linkage */
+        uint64_t period; /* ns, 0 unless created periodic */
+        uint64_t budget; /* ns of CPU admitted per period */
+        uint64_t used; /* ns of budget spent since the current release */
+        uint64_t refilled; /* monotonic ns used was last reset mid-run */
+        uint64_t release; /* monotonic ns the current period began */
+        uint64_t misses; /* periods that ended after their deadline */
+        uint64_t id; /* 1, 2, ... in order of creation */
+        uint64_t readied; /* monotonic ns it last became runnable */
+        struct scheduler_stats stats;
+        void** specific; /* SCHEDULER_KEYS values, allocated on first set */
+        struct scheduler_scope* scope; /* NULL, or its task group's, referenced */
+        struct scheduler_queue* queue; /* wait queue it was last put on */
+        int* waiting; /* lock of queue while parked cancellably, else NULL */
+        int aborted; /* taken off queue by the cancellation of its scope */
+        struct job* wnext; /* on the waiting list of its scope */
+        struct job* wprev;
+        void* result; /* exit value handed to scheduler_join() */
+        int refs; /* the scheduler until termination, the handle until joined */
+        int lock; /* guards status and joiners */
+        struct scheduler_queue joiners;
         struct job* next;
 };
 
-struct scheduler {
-        jmp_buf env;
-        struct job* head;
-        struct job* curr;
-        struct job* prev;
+/**
+ * scheduler_config selects how the scheduler maps user threads onto
+ * kernel threads.
+ *
+ * workers   : number of kernel threads running user threads; 1 runs every
+ *             user thread on the thread calling scheduler_execute(), 0
+ *             spawns one worker per online core (M:N)
+ * quantum_us: period of the preemption timer in microseconds, and the
+ *             default time slice of a user thread; 0 selects
+ *             SCHEDULER_QUANTUM_US, smaller values are raised to
+ *             SCHEDULER_QUANTUM_MIN_US
+ * policy    : the scheduling policy, one of
+ *             SCHEDULER_RR  : round-robin with work stealing (default)
+ *             SCHEDULER_MLFQ: multi-level feedback queue; a user thread
+ *                             that uses up its slice is demoted to a lower
+ *                             level with a longer slice, one that yields or
+ *                             blocks early is promoted, and all are boosted
+ *                             back to their priority periodically
+ *             SCHEDULER_CFS : completely fair; each user thread gets a CPU
+ *                             share proportional to its weight, tracked
+ *                             as virtual runtime in a red-black tree
+ *             SCHEDULER_EDF : earliest deadline first among periodic user
+ *                             threads, aperiodic ones run in the
+ *                             background
+ * trace     : context switches kept per worker for scheduler_trace_dump(),
+ *             the oldest are overwritten; 0 disables tracing
+ * preempt   : how a user thread that used up its slice is preempted
+ *             SCHEDULER_PREEMPT_SIGNAL: right away, from the SIGALRM
+ *                                       handler (default)
+ *             SCHEDULER_PREEMPT_POLL  : at its next scheduler_poll(); the
+ *                                       handler only raises a flag
+ */
+struct scheduler_config {
+        size_t workers;
+        uint64_t quantum_us;
+        int policy;
+        size_t trace;
+        int preempt;
 };
 
-void scheduler_init(void);
+#define SCHEDULER_QUANTUM_US 10000
+#define SCHEDULER_QUANTUM_MIN_US 100
+#define SCHEDULER_PRIORITIES 8
+#define SCHEDULER_WEIGHT 1024
+#define SCHEDULER_KEYS 64
+#define SCHEDULER_DESTRUCTOR_ITERATIONS 4
+
+enum {
+        SCHEDULER_RR,
+        SCHEDULER_MLFQ,
+        SCHEDULER_CFS,
+        SCHEDULER_EDF
+};
+
+enum {
+        SCHEDULER_PREEMPT_SIGNAL,
+        SCHEDULER_PREEMPT_POLL
+};
+
+/**
+ * Initializes the scheduler.
+ *
+ * config: the scheduler configuration, or NULL for a single worker
+ */
+
+void scheduler_init(const struct scheduler_config *config);
 
 /**
  * Creates a new user thread.
@@ -50,10 +198,130 @@ void scheduler_init(void);
  * fnc: the start function of the user thread (see scheduler_fnc_t)
  * arg: a pass-through pointer defining the context of the user thread
  *
+ * return: an opaque handle to be passed to exactly one of scheduler_join()
+ *         or scheduler_detach(), or NULL on error
+ *
+ * Note: must be called before scheduler_execute() or from within a user
+ *       thread.
+ */
+
+struct job *scheduler_create(scheduler_fnc_t fnc, void *arg);
+
+/**
+ * Waits for a user thread to terminate and releases its handle. Called
+ * from within a user thread, the caller is parked until the target
+ * terminates; outside of the scheduler (e.g., after scheduler_execute())
+ * the target must already have terminated.
+ *
+ * job   : a handle previously obtained by calling scheduler_create()
+ * result: if not NULL, receives the value the target passed to
+ *         scheduler_exit(), or NULL if it returned from its function
+ *
  * return: 0 on success, otherwise error
  */
 
-int scheduler_create(scheduler_fnc_t fnc, void *arg);
+int scheduler_join(struct job *job, void **result);
+
+/**
+ * Releases the handle of a user thread that will never be joined; its
+ * resources are reclaimed as soon as it terminates.
+ */
+
+void scheduler_detach(struct job *job);
+
+/**
+ * Called from within a user thread to terminate it with the given result,
+ * as if its function had returned.
+ */
+
+void scheduler_exit(void *result);
+
+/**
+ * Creates a periodic user thread. Its function does one period's work and
+ * then calls scheduler_wait_period(), typically in a loop. Its deadline is
+ * the end of each period, which is what SCHEDULER_EDF schedules by, and it
+ * is preempted once it has run for its budget. Having spent it, it waits
+ * for the next period, each period it overran counting a deadline miss.
+ *
+ * Admission control: the thread is only created if the total utilization
+ * (budget / period) of periodic user threads stays within the number of
+ * workers.
+ *
+ * fnc   : the start function of the user thread (see scheduler_fnc_t)
+ * arg   : a pass-through pointer defining the context of the user thread
+ * period: the period in microseconds, the first one starts right away
+ * budget: the CPU time needed per period in microseconds
+ *
+ * return: as scheduler_create(), NULL also if admission failed
+ */
+
+struct job *scheduler_create_periodic(scheduler_fnc_t fnc,
+                                      void *arg,
+                                      uint64_t period,
+                                      uint64_t budget);
+
+/**
+ * scheduler_offload_fnc_t defines the signature of a blocking call handed
+ * to scheduler_offload().
+ */
+
+typedef void *(*scheduler_offload_fnc_t)(void *arg);
+
+/**
+ * Runs fnc(arg) on one of a few helper kernel threads, parking the calling
+ * user thread until it returns, so a call that cannot be made non-blocking
+ * (regular file I/O, fsync(), stat(), getaddrinfo(), ...) stalls neither
+ * the worker nor the other user threads. The helpers start with the first
+ * offload and stop when scheduler_execute() returns; the worker is woken
+ * through its eventfd when the call completes.
+ *
+ * Note: fnc runs outside the scheduler and must not call into it.
+ *
+ * return: what fnc returned; called outside a user thread, fnc simply runs
+ *         on the calling thread
+ */
+
+void *scheduler_offload(scheduler_offload_fnc_t fnc, void *arg);
+
+/**
+ * Called from within a periodic user thread when the work of the current
+ * period is done; parks it until the next period begins. Finishing after
+ * the end of the period counts a deadline miss and starts the next period
+ * right away.
+ */
+
+void scheduler_wait_period(void);
+
+/**
+ * Returns the number of deadline misses of a periodic user thread.
+ */
+
+uint64_t scheduler_misses(const struct job *job);
+
+/**
+ * Reads the statistics of a user thread, or with job NULL the totals over
+ * all user threads of the current or, after scheduler_execute() returned,
+ * the last run. Counters of a running thread are a racy snapshot.
+ *
+ * job  : a handle not yet joined or detached, or NULL
+ * stats: receives the counters
+ *
+ * return: 0 on success, -1 on error
+ */
+
+int scheduler_stats(const struct job *job, struct scheduler_stats *stats);
+
+/**
+ * Writes the context switches recorded by the trace ring buffers (see
+ * scheduler_config) to pathname as Chrome trace-event JSON, one track per
+ * worker and one slice per time a user thread held the CPU. Meant to be
+ * called once scheduler_execute() returned; the trace stays available
+ * until the next scheduler_init().
+ *
+ * return: 0 on success, -1 on error or if tracing is disabled
+ */
+
+int scheduler_trace_dump(const char *pathname);
 
 /**
  * Called to execute the user threads previously created by calling
@@ -64,6 +332,9 @@ int scheduler_create(scheduler_fnc_t fnc, void *arg);
  *     scheduler_create() calls.
  *   * This function returns after all user threads (previously created)
  *     have terminated.
+ *   * With more than one worker, the calling thread runs as worker 0 and
+ *     the remaining workers are spawned as pthreads; idle workers steal
+ *     runnable user threads from the others.
  *   * This function is not re-enterant.
  */
 
@@ -76,8 +347,260 @@ void scheduler_execute(void);
 void scheduler_yield(void);
 
 /**
- * Handler to handle the sigalrm interrupt
+ * Called from within a user thread to sleep for at least us microseconds.
+ * Only the calling user thread is parked, on its worker's timer heap; the
+ * worker keeps running other user threads and, when none is runnable,
+ * blocks until the earliest sleeper is due.
+ *
+ * us: the sleep duration in microseconds
+ *
+ * Note: outside of a user thread this falls back to us_sleep().
+ */
+
+void scheduler_sleep(uint64_t us);
+
+/**
+ * Analogous to read(), write() and accept(), but called from within a user
+ * thread they only park the calling user thread when fd would block. fd is
+ * put in non-blocking mode and, if the call returns EAGAIN, registered
+ * one-shot with the worker's epoll reactor; the thread is resumed once fd
+ * is ready and the call is retried. Accepted sockets are non-blocking.
+ *
+ * Notes:
+ *   * A reader and a writer may be parked on the same fd; the threads
+ *     parked for the same readiness are all resumed and retry.
+ *   * Outside of a user thread these are the plain blocking calls.
+ *
+ * return: as the underlying system call
+ */
+
+ssize_t scheduler_read(int fd, void *buf, size_t n);
+
+ssize_t scheduler_write(int fd, const void *buf, size_t n);
+
+int scheduler_accept(int fd, struct sockaddr *addr, socklen_t *len);
+
+/**
+ * Sets the priority of the calling user thread, from 0 (highest) to
+ * SCHEDULER_PRIORITIES - 1. Under SCHEDULER_MLFQ it is the highest level
+ * the thread can be promoted to; SCHEDULER_RR ignores it. New user threads
+ * inherit the priority of their creator.
+ */
+
+void scheduler_set_priority(int priority);
+
+/**
+ * Sets the weight of the calling user thread under SCHEDULER_CFS; runnable
+ * threads share the CPU in proportion to their weights. The default is
+ * SCHEDULER_WEIGHT and new user threads inherit the weight of their
+ * creator.
+ *
+ * weight: the weight, at least 1
  */
-void interrupt_handler(int signal);
+
+void scheduler_set_weight(uint64_t weight);
+
+/**
+ * Sets the time-slice budget of the calling user thread. The thread is
+ * preempted at the timer tick closest to the end of the slice, us
+ * microseconds after it was last dispatched, so the effective slice is
+ * within half a quantum of us either way.
+ *
+ * us: the time slice in microseconds; 0 restores the quantum
+ *
+ * Note: SCHEDULER_MLFQ and SCHEDULER_CFS derive the slice themselves.
+ */
+
+void scheduler_set_slice(uint64_t us);
+
+/**
+ * Safepoint polling, for SCHEDULER_PREEMPT_POLL. Preempting from the
+ * signal handler can stop a user thread anywhere, inside malloc() or
+ * stdio included, and costs a signal delivery per preemption. In poll
+ * mode the timer only sets scheduler_preempt_pending for the worker, and
+ * the user thread yields where it calls scheduler_poll(), a load and a
+ * branch, typically once per iteration of a long loop. A user thread that
+ * neither polls nor blocks is never preempted in poll mode.
+ *
+ * scheduler_safepoint() yields the CPU as a preemption (also a
+ * cancellation point); scheduler_poll() calls it when a tick asked for it.
+ */
+
+extern __thread volatile sig_atomic_t scheduler_preempt_pending;
+
+void scheduler_safepoint(void);
+
+#define scheduler_poll()				\
+	do {						\
+		if (scheduler_preempt_pending) {	\
+			scheduler_safepoint();		\
+		}					\
+	} while (0)
+
+/**
+ * Stack sizing. Every stack ends in a canary that is checked each time its
+ * user thread switches out, so an overflow that has not crashed the
+ * process yet stops it there. The first threads created for each thread
+ * function, and a sample of the later ones, have their whole stack filled
+ * with canaries and scanned when they exit. The deepest use seen sizes the
+ * stacks of new threads running the same function: a quarter more than
+ * that plus room for preemption signal frames, measured at
+ * scheduler_init() and not needed in poll mode; down from the default of
+ * a few pages for small threads and up for deep ones.
+ *
+ * scheduler_stack_report() writes one line per thread function: threads
+ * created, stacks measured, deepest use and current stack size in bytes.
+ */
+
+void scheduler_stack_report(FILE *file);
+
+/**
+ * Deferred cancellation. A user thread whose scope was cancelled exits
+ * with the result SCHEDULER_CANCELED the next time it reaches a
+ * cancellation point outside a critical section: scheduler_yield(),
+ * scheduler_sleep(), scheduler_wait_period(), waiting in scheduler_read(),
+ * scheduler_write() or scheduler_accept(), scheduler_chan_send(),
+ * scheduler_chan_recv(), waiting in scheduler_future_get(),
+ * scheduler_join(), scheduler_mutex_lock() or scheduler_cond_wait(),
+ * scheduler_safepoint(), or scheduler_testcancel(). A thread parked in one
+ * of these waits when cancelled is taken off its wait queue and exits at
+ * once; one asleep or waiting for I/O notices once it is woken.
+ * Fiber-local storage destructors run as with scheduler_exit().
+ *
+ * scheduler_cancelled() returns 1 if the calling user thread has been
+ * cancelled, so that long computations can stop at a convenient point.
+ */
+
+int scheduler_cancelled(void);
+
+void scheduler_testcancel(void);
+
+/**
+ * Fiber-local storage, the user thread analogue of pthread_key_create().
+ * A __thread variable is shared by all user threads that happen to run on
+ * the same worker; a value set under a key belongs to the calling user
+ * thread alone and follows it across switches and workers.
+ *
+ * scheduler_key_create() allocates one of SCHEDULER_KEYS keys, with every
+ * user thread's value NULL. When a user thread exits, the destructor (if
+ * not NULL) of each key with a non-NULL value is called with that value,
+ * which is reset to NULL first; this repeats up to
+ * SCHEDULER_DESTRUCTOR_ITERATIONS times while destructors set new values.
+ * scheduler_key_delete() frees a key without calling destructors.
+ *
+ * return: 0 on success, -1 on error; scheduler_getspecific() returns the
+ *         value, or NULL if none was set
+ *
+ * Note: getspecific and setspecific must be called from within a user
+ *       thread.
+ */
+
+typedef unsigned scheduler_key_t;
+
+int scheduler_key_create(scheduler_key_t *key, void (*destructor)(void *));
+
+int scheduler_key_delete(scheduler_key_t key);
+
+void *scheduler_getspecific(scheduler_key_t key);
+
+int scheduler_setspecific(scheduler_key_t key, const void *value);
+
+/**
+ * malloc() and free() for code running in user threads. The calling user
+ * thread is not preempted inside the allocator, where it could hold the
+ * allocator's lock while its worker, running another user thread, tries
+ * to take it. Outside a user thread they are plain malloc() and free().
+ */
+
+void *scheduler_malloc(size_t n);
+
+void scheduler_free(void *p);
+
+/**
+ * Low-level parking interface, used to build the synchronization
+ * primitives in sync.h.
+ *
+ * A wait queue is guarded by a spinlock taken with scheduler_lock(), which
+ * also keeps the calling user thread from being preempted while it holds
+ * the lock. scheduler_park() suspends the calling user thread (which must
+ * already be on some wait queue) and its worker releases the lock only once
+ * it is off the thread's stack, so a waker can never resume a thread that
+ * is still parking. scheduler_unpark() makes a parked thread runnable on
+ * the calling worker, ahead of its other runnable threads.
+ *
+ * Note: scheduler_park() and scheduler_unpark() must be called from
+ *       within a user thread.
+ */
+
+void scheduler_lock(int *lock);
+
+void scheduler_unlock(int *lock);
+
+struct job *scheduler_self(void);
+
+/**
+ * Creates a user thread like scheduler_create(), but in scope instead of
+ * the scope of the calling user thread. Threads it creates inherit scope.
+ */
+
+struct job *scheduler_create_in(struct scheduler_scope *scope,
+                                scheduler_fnc_t fnc,
+                                void *arg);
+
+/**
+ * Sets up scope with one reference, held by the caller, nested in parent,
+ * which may be NULL.
+ */
+
+void scheduler_scope_init(struct scheduler_scope *scope,
+                          struct scheduler_scope *parent,
+                          void (*release)(struct scheduler_scope *scope));
+
+/**
+ * Takes and drops a reference to scope. Dropping the last one releases
+ * scope, then drops its reference to its parent.
+ *
+ * Note: scope may be NULL
+ */
+
+void scheduler_scope_get(struct scheduler_scope *scope);
+
+void scheduler_scope_put(struct scheduler_scope *scope);
+
+/**
+ * Cancels scope, and with it the scopes nested in it. The user threads
+ * parked cancellably in any of them are taken off their wait queues and
+ * made runnable; the others notice at their next cancellation point.
+ */
+
+void scheduler_scope_cancel(struct scheduler_scope *scope);
+
+void scheduler_park(int *lock);
+
+/**
+ * Parks like scheduler_park(), but as a cancellation point: if the scope
+ * of the calling user thread is or gets cancelled, the thread is taken off
+ * the wait queue it was last put on and lock is released. A thread inside
+ * a critical section is not cancelled.
+ *
+ * return: 0 once woken, -1 if cancelled; the caller then undoes what it
+ *         must and calls scheduler_testcancel(), which does not return
+ */
+
+int scheduler_park_cancellable(int *lock);
+
+void scheduler_unpark(struct job *job);
+
+void scheduler_queue_push(struct scheduler_queue *queue, struct job *job);
+
+struct job *scheduler_queue_pop(struct scheduler_queue *queue);
+
+/**
+ * Handler of the SIGALRM preemption tick. scheduler_execute() installs it
+ * with sigaction() and arms a per-worker timer; it preempts the running
+ * user thread once its time slice is used up.
+ */
+
+void interrupt_handler(int signum);
 
 #endif /* _SCHEDULER_H_ */
@@ -0,0 +1,275 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * sync.c
+ */
+
+#include "sync.h"
+
+struct scheduler_mutex {
+        int lock;
+        int locked;
+        struct scheduler_queue waiters;
+};
+
+struct scheduler_cond {
+        int lock;
+        struct scheduler_queue waiters;
+};
+
+struct scheduler_chan {
+        int lock;
+        int shutdown;
+        size_t capacity;
+        size_t head;
+        size_t size;
+        void** buf;
+        struct scheduler_queue senders; /* value to send in job->xfer */
+        struct scheduler_queue receivers;
+};
+
+struct scheduler_mutex *scheduler_mutex_open(void) {
+        struct scheduler_mutex* mutex;
+
+        if (!(mutex = (struct scheduler_mutex*)scheduler_malloc(sizeof (struct scheduler_mutex)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(mutex, 0, sizeof (struct scheduler_mutex));
+        return mutex;
+}
+
+void scheduler_mutex_close(struct scheduler_mutex *mutex) {
+        if (mutex) {
+                assert( !mutex->locked && !mutex->waiters.head );
+                scheduler_free(mutex);
+        }
+}
+
+void scheduler_mutex_lock(struct scheduler_mutex *mutex) {
+        scheduler_lock(&mutex->lock);
+        if (!mutex->locked) {
+                mutex->locked = 1;
+                scheduler_unlock(&mutex->lock);
+                return;
+        }
+        scheduler_queue_push(&mutex->waiters, scheduler_self());
+        if (scheduler_park_cancellable(&mutex->lock)) {
+                scheduler_testcancel();
+        }
+        /* the unlocker handed the mutex over, it is still locked */
+}
+
+int scheduler_mutex_trylock(struct scheduler_mutex *mutex) {
+        int busy;
+
+        scheduler_lock(&mutex->lock);
+        if (!(busy = mutex->locked)) {
+                mutex->locked = 1;
+        }
+        scheduler_unlock(&mutex->lock);
+        return busy;
+}
+
+void scheduler_mutex_unlock(struct scheduler_mutex *mutex) {
+        struct job* j;
+
+        scheduler_lock(&mutex->lock);
+        assert( mutex->locked );
+        if (NULL == (j = scheduler_queue_pop(&mutex->waiters))) {
+                mutex->locked = 0;
+        }
+        scheduler_unlock(&mutex->lock);
+        if (j) {
+                scheduler_unpark(j);
+        }
+}
+
+struct scheduler_cond *scheduler_cond_open(void) {
+        struct scheduler_cond* cond;
+
+        if (!(cond = (struct scheduler_cond*)scheduler_malloc(sizeof (struct scheduler_cond)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(cond, 0, sizeof (struct scheduler_cond));
+        return cond;
+}
+
+void scheduler_cond_close(struct scheduler_cond *cond) {
+        if (cond) {
+                assert( !cond->waiters.head );
+                scheduler_free(cond);
+        }
+}
+
+void scheduler_cond_wait(struct scheduler_cond *cond, struct scheduler_mutex *mutex) {
+        /**
+         * queue up before releasing the mutex, a signal issued after the
+         * unlock cannot miss us since it needs cond->lock, which is held
+         * until we are parked
+         */
+        scheduler_lock(&cond->lock);
+        scheduler_queue_push(&cond->waiters, scheduler_self());
+        scheduler_mutex_unlock(mutex);
+        if (scheduler_park_cancellable(&cond->lock)) {
+                /* exits without the mutex, which nobody would unlock */
+                scheduler_testcancel();
+        }
+        scheduler_mutex_lock(mutex);
+}
+
+void scheduler_cond_signal(struct scheduler_cond *cond) {
+        struct job* j;
+
+        scheduler_lock(&cond->lock);
+        j = scheduler_queue_pop(&cond->waiters);
+        scheduler_unlock(&cond->lock);
+        if (j) {
+                scheduler_unpark(j);
+        }
+}
+
+void scheduler_cond_broadcast(struct scheduler_cond *cond) {
+        struct scheduler_queue woken;
+        struct job* j;
+
+        woken.head = NULL;
+        woken.tail = NULL;
+        scheduler_lock(&cond->lock);
+        while (NULL != (j = scheduler_queue_pop(&cond->waiters))) {
+                scheduler_queue_push(&woken, j);
+        }
+        scheduler_unlock(&cond->lock);
+        while (NULL != (j = scheduler_queue_pop(&woken))) {
+                scheduler_unpark(j);
+        }
+}
+
+struct scheduler_chan *scheduler_chan_open(size_t capacity) {
+        struct scheduler_chan* chan;
+
+        if (!(chan = (struct scheduler_chan*)scheduler_malloc(sizeof (struct scheduler_chan)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        memset(chan, 0, sizeof (struct scheduler_chan));
+        chan->capacity = capacity;
+        if (capacity && !(chan->buf = (void**)scheduler_malloc(capacity * sizeof (void*)))) {
+                TRACE("out of memory");
+                scheduler_free(chan);
+                return NULL;
+        }
+        return chan;
+}
+
+void scheduler_chan_close(struct scheduler_chan *chan) {
+        if (chan) {
+                assert( !chan->senders.head && !chan->receivers.head );
+                scheduler_free(chan->buf);
+                scheduler_free(chan);
+        }
+}
+
+int scheduler_chan_send(struct scheduler_chan *chan, void *value) {
+        struct job* self;
+        struct job* j;
+
+        scheduler_testcancel();
+        scheduler_lock(&chan->lock);
+        if (chan->shutdown) {
+                scheduler_unlock(&chan->lock);
+                return -1;
+        }
+        if (NULL != (j = scheduler_queue_pop(&chan->receivers))) {
+                /* a receiver is waiting, so the buffer is empty */
+                j->xfer = value;
+                j->xfer_ok = 1;
+                scheduler_unlock(&chan->lock);
+                scheduler_unpark(j);
+                return 0;
+        }
+        if (chan->size < chan->capacity) {
+                chan->buf[(chan->head + chan->size++) % chan->capacity] = value;
+                scheduler_unlock(&chan->lock);
+                return 0;
+        }
+        self = scheduler_self();
+        self->xfer = value;
+        self->xfer_ok = 0;
+        scheduler_queue_push(&chan->senders, self);
+        if (scheduler_park_cancellable(&chan->lock)) {
+                scheduler_testcancel();
+        }
+        return self->xfer_ok ? 0 : -1;
+}
+
+int scheduler_chan_recv(struct scheduler_chan *chan, void **value) {
+        struct job* self;
+        struct job* j;
+
+        scheduler_testcancel();
+        scheduler_lock(&chan->lock);
+        if (chan->size) {
+                *value = chan->buf[chan->head];
+                chan->head = (chan->head + 1) % chan->capacity;
+                chan->size--;
+                /* refill the freed slot from the longest waiting sender */
+                if (NULL != (j = scheduler_queue_pop(&chan->senders))) {
+                        chan->buf[(chan->head + chan->size++) % chan->capacity] = j->xfer;
+                        j->xfer_ok = 1;
+                }
+                scheduler_unlock(&chan->lock);
+                if (j) {
+                        scheduler_unpark(j);
+                }
+                return 0;
+        }
+        if (NULL != (j = scheduler_queue_pop(&chan->senders))) {
+                /* unbuffered rendezvous */
+                *value = j->xfer;
+                j->xfer_ok = 1;
+                scheduler_unlock(&chan->lock);
+                scheduler_unpark(j);
+                return 0;
+        }
+        if (chan->shutdown) {
+                scheduler_unlock(&chan->lock);
+                return -1;
+        }
+        self = scheduler_self();
+        self->xfer_ok = 0;
+        scheduler_queue_push(&chan->receivers, self);
+        if (scheduler_park_cancellable(&chan->lock)) {
+                scheduler_testcancel();
+        }
+        if (!self->xfer_ok) {
+                return -1;
+        }
+        *value = self->xfer;
+        return 0;
+}
+
+void scheduler_chan_shutdown(struct scheduler_chan *chan) {
+        struct scheduler_queue woken;
+        struct job* j;
+
+        scheduler_lock(&chan->lock);
+        chan->shutdown = 1;
+        woken.head = NULL;
+        woken.tail = NULL;
+        while (NULL != (j = scheduler_queue_pop(&chan->receivers))) {
+                scheduler_queue_push(&woken, j);
+        }
+        while (NULL != (j = scheduler_queue_pop(&chan->senders))) {
+                j->xfer_ok = 0;
+                scheduler_queue_push(&woken, j);
+        }
+        scheduler_unlock(&chan->lock);
+        while (NULL != (j = scheduler_queue_pop(&woken))) {
+                scheduler_unpark(j);
+        }
+}
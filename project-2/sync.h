@@ -0,0 +1,146 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * sync.h
+ */
+
+#ifndef _SYNC_H_
+#define _SYNC_H_
+
+#include "scheduler.h"
+
+/**
+ * Parking synchronization primitives for user threads. A user thread that
+ * has to wait is put on a wait queue and switched out instead of spinning
+ * around scheduler_yield(); the waker hands the lock or value over directly
+ * and the woken thread runs next on the waker's worker.
+ *
+ * Note: the blocking calls must be made from within a user thread.
+ */
+
+struct scheduler_mutex;
+struct scheduler_cond;
+struct scheduler_chan;
+
+/**
+ * Creates an unlocked mutex.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct scheduler_mutex *scheduler_mutex_open(void);
+
+/**
+ * Destroys a mutex. No user thread may hold or wait for it.
+ *
+ * Note: mutex may be NULL
+ */
+
+void scheduler_mutex_close(struct scheduler_mutex *mutex);
+
+/**
+ * Locks mutex, parking the calling user thread while another one holds it.
+ * Waiters acquire the mutex in FIFO order.
+ */
+
+void scheduler_mutex_lock(struct scheduler_mutex *mutex);
+
+/**
+ * Locks mutex if it is free.
+ *
+ * return: 0 if the mutex was locked, otherwise it is held elsewhere
+ */
+
+int scheduler_mutex_trylock(struct scheduler_mutex *mutex);
+
+/**
+ * Unlocks mutex, handing ownership to the longest waiting user thread.
+ */
+
+void scheduler_mutex_unlock(struct scheduler_mutex *mutex);
+
+/**
+ * Creates a condition variable.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct scheduler_cond *scheduler_cond_open(void);
+
+/**
+ * Destroys a condition variable. No user thread may wait on it.
+ *
+ * Note: cond may be NULL
+ */
+
+void scheduler_cond_close(struct scheduler_cond *cond);
+
+/**
+ * Atomically unlocks mutex and parks the calling user thread on cond; the
+ * mutex is locked again before returning. As with pthreads, the caller
+ * re-checks its predicate in a loop. A user thread cancelled while it
+ * waits exits without the mutex.
+ */
+
+void scheduler_cond_wait(struct scheduler_cond *cond, struct scheduler_mutex *mutex);
+
+/**
+ * Wakes the longest waiting user thread on cond, if any.
+ */
+
+void scheduler_cond_signal(struct scheduler_cond *cond);
+
+/**
+ * Wakes every user thread waiting on cond.
+ */
+
+void scheduler_cond_broadcast(struct scheduler_cond *cond);
+
+/**
+ * Creates a bounded channel of pointers.
+ *
+ * capacity: the number of buffered values; 0 makes every send rendezvous
+ *           with a receive
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct scheduler_chan *scheduler_chan_open(size_t capacity);
+
+/**
+ * Destroys a channel. No user thread may wait on it.
+ *
+ * Note: chan may be NULL
+ */
+
+void scheduler_chan_close(struct scheduler_chan *chan);
+
+/**
+ * Sends value, parking the calling user thread while the channel is full.
+ * A waiting receiver gets the value directly.
+ *
+ * return: 0 on success, otherwise the channel was shut down
+ */
+
+int scheduler_chan_send(struct scheduler_chan *chan, void *value);
+
+/**
+ * Receives a value into *value, parking the calling user thread while the
+ * channel is empty.
+ *
+ * return: 0 on success, otherwise the channel was shut down and drained
+ */
+
+int scheduler_chan_recv(struct scheduler_chan *chan, void **value);
+
+/**
+ * Shuts the channel down: pending and future sends fail, receivers drain
+ * the buffered values and then fail.
+ */
+
+void scheduler_chan_shutdown(struct scheduler_chan *chan);
+
+#endif /* _SYNC_H_ */
@@ -0,0 +1,557 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * test.c
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include "system.h"
+#include "scheduler.h"
+#include "future.h"
+#include "group.h"
+#include "sync.h"
+
+/**
+ * Regression tests of the scheduler, each a function returning 0 when it
+ * passes:
+ *
+ *   make test && ./cs238-test [name]
+ *
+ * Checks that fail inside user threads are counted in _failed_ rather
+ * than asserted, so that one run reports every failing test.
+ */
+
+static int _failed_;
+
+#define CHECK(c)                                                        \
+        do {                                                            \
+                if (!(c)) {                                             \
+                        TRACE("check failed: " #c);                     \
+                        __atomic_add_fetch(&_failed_, 1, __ATOMIC_SEQ_CST); \
+                }                                                       \
+        } while (0)
+
+static void _init_(size_t workers, uint64_t quantum_us, int policy) {
+        struct scheduler_config config;
+
+        memset(&config, 0, sizeof (config));
+        config.workers = workers;
+        config.quantum_us = quantum_us;
+        config.policy = policy;
+        scheduler_init(&config);
+}
+
+static void _spawn_(scheduler_fnc_t fnc, void* arg) {
+        struct job* job;
+
+        if (!(job = scheduler_create(fnc, arg))) {
+                EXIT("scheduler_create()");
+        }
+        scheduler_detach(job);
+}
+
+static void _spin_(uint64_t us) {
+        struct timespec a;
+        struct timespec b;
+
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        do {
+                clock_gettime(CLOCK_MONOTONIC, &b);
+        } while ((uint64_t)((b.tv_sec - a.tv_sec) * 1000000 + (b.tv_nsec - a.tv_nsec) / 1000) < us);
+}
+
+/**
+ * spins us of CPU time in short steps, time spent preempted mostly not
+ * counting towards it
+ */
+static void _work_(uint64_t us) {
+        uint64_t i;
+
+        for (i=0; i<us; i+=10) {
+                _spin_(10);
+        }
+}
+
+/* offload -------------------------------------------------------------- */
+
+#define OFFLOAD_JOBS 32
+#define OFFLOAD_CALLS 7
+
+static void* _offload_call_(void* arg) {
+        usleep(1000);
+        return arg;
+}
+
+static void _offload_job_(void* arg) {
+        struct job* self;
+        size_t i;
+
+        self = scheduler_self();
+        for (i=0; i<OFFLOAD_CALLS; ++i) {
+                CHECK( arg == scheduler_offload(_offload_call_, arg) );
+                CHECK( self == scheduler_self() );
+                CHECK( 0 == self->critical );
+                _spin_(200);
+        }
+}
+
+static void _offload_spinner_(void* arg) {
+        uint64_t end;
+        struct timespec ts;
+
+        UNUSED(arg);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        end = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000 + 50;
+        do {
+                CHECK( 0 == scheduler_self()->critical );
+                scheduler_yield();
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+        } while ((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000 < end);
+}
+
+/**
+ * offloading jobs on several workers come back with their own critical
+ * count at 0 and leave the other jobs' counts alone
+ */
+static int _test_offload_(void) {
+        size_t i;
+
+        _init_(4, 100, SCHEDULER_RR);
+        for (i=0; i<OFFLOAD_JOBS; ++i) {
+                _spawn_(_offload_job_, (void*)(i + 1));
+                _spawn_(_offload_spinner_, NULL);
+        }
+        scheduler_execute();
+        return 0;
+}
+
+/* overrun ------------------------------------------------------------- */
+
+#define OVERRUN_PERIODS 2
+
+static int _overrun_done_;
+static uint64_t _overrun_ticks_;
+static uint64_t _overrun_misses_;
+
+static void _overrun_periodic_(void* arg) {
+        size_t i;
+
+        UNUSED(arg);
+        for (i=0; i<OVERRUN_PERIODS; ++i) {
+                _work_(30000);
+                scheduler_wait_period();
+        }
+        _overrun_misses_ = scheduler_misses(scheduler_self());
+        __atomic_store_n(&_overrun_done_, 1, __ATOMIC_SEQ_CST);
+}
+
+static void _overrun_background_(void* arg) {
+        UNUSED(arg);
+        while (!__atomic_load_n(&_overrun_done_, __ATOMIC_SEQ_CST)) {
+                _work_(1000);
+                _overrun_ticks_++;
+        }
+}
+
+/**
+ * a periodic job spinning 30ms a period on a 2ms budget is held off until
+ * its next release, so a background job on the same worker gets the CPU
+ * while it overruns
+ */
+static int _test_overrun_(void) {
+        struct job* job;
+
+        _overrun_done_ = 0;
+        _overrun_ticks_ = 0;
+        _overrun_misses_ = 0;
+        _init_(1, 1000, SCHEDULER_EDF);
+        if (!(job = scheduler_create_periodic(_overrun_periodic_, NULL, 10000, 2000))) {
+                EXIT("scheduler_create_periodic()");
+        }
+        scheduler_detach(job);
+        _spawn_(_overrun_background_, NULL);
+        scheduler_execute();
+        /* 60ms of overrun at 2ms per 10ms leaves the background most of ~300ms */
+        CHECK( 100 <= _overrun_ticks_ );
+        /* each 30ms of work takes some 15 budgets, every period but its last missed */
+        CHECK( 10 <= _overrun_misses_ );
+        CHECK( 40 >= _overrun_misses_ );
+        return 0;
+}
+
+/* slice ---------------------------------------------------------------- */
+
+#define SLICE_QUANTUM_US 1000
+
+static uint64_t _slice_runs_;
+static uint64_t _slice_ran_;
+
+static uint64_t _slice_now_(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void _slice_job_(void* arg) {
+        uint64_t start;
+        uint64_t first;
+        uint64_t last;
+        uint64_t now;
+
+        UNUSED(arg);
+        first = start = last = _slice_now_();
+        while ((now = _slice_now_()) < first + 100000) {
+                if (100 < (now - last)) {
+                        /* was switched out at last, a new slice began */
+                        __atomic_add_fetch(&_slice_runs_, 1, __ATOMIC_SEQ_CST);
+                        __atomic_add_fetch(&_slice_ran_, last - start, __ATOMIC_SEQ_CST);
+                        start = now;
+                }
+                last = now;
+        }
+}
+
+/**
+ * two spinning jobs on one worker take turns of about a quantum each,
+ * rather than running on to the tick after their slice ends
+ */
+static int _test_slice_(void) {
+        uint64_t average;
+
+        _slice_runs_ = 0;
+        _slice_ran_ = 0;
+        _init_(1, SLICE_QUANTUM_US, SCHEDULER_RR);
+        _spawn_(_slice_job_, NULL);
+        _spawn_(_slice_job_, NULL);
+        scheduler_execute();
+        CHECK( 10 <= _slice_runs_ );
+        average = _slice_runs_ ? (_slice_ran_ / _slice_runs_) : 0;
+        CHECK( (SLICE_QUANTUM_US / 2) <= average );
+        CHECK( (SLICE_QUANTUM_US * 3 / 2) >= average );
+        return 0;
+}
+
+/* wake ----------------------------------------------------------------- */
+
+#define WAKE_SLEEPS 20
+
+static int _wake_done_;
+static uint64_t _wake_late_;
+
+static void _wake_sleeper_(void* arg) {
+        uint64_t due;
+        int i;
+
+        UNUSED(arg);
+        for (i=0; i<WAKE_SLEEPS; ++i) {
+                due = _slice_now_() + 200;
+                scheduler_sleep(200);
+                _wake_late_ += _slice_now_() - due;
+        }
+        __atomic_store_n(&_wake_done_, 1, __ATOMIC_SEQ_CST);
+}
+
+static void _wake_spinner_(void* arg) {
+        UNUSED(arg);
+        while (!__atomic_load_n(&_wake_done_, __ATOMIC_SEQ_CST)) {
+        }
+}
+
+/**
+ * a sleeper that comes due during the slice of a spinning job runs at the
+ * end of that slice, before the spinner is given its next one
+ */
+static int _test_wake_(void) {
+        _wake_done_ = 0;
+        _wake_late_ = 0;
+        _init_(1, SLICE_QUANTUM_US, SCHEDULER_RR);
+        _spawn_(_wake_sleeper_, NULL);
+        _spawn_(_wake_spinner_, NULL);
+        scheduler_execute();
+        CHECK( (SLICE_QUANTUM_US * 5 / 4) >= (_wake_late_ / WAKE_SLEEPS) );
+        return 0;
+}
+
+/* scope ---------------------------------------------------------------- */
+
+static int _scope_lock_;
+static int _scope_closed_;
+
+static void _scope_grandchild_(void* arg) {
+        UNUSED(arg);
+        while (!__atomic_load_n(&_scope_closed_, __ATOMIC_SEQ_CST)) {
+                scheduler_yield();
+        }
+        /* still the group's scope, which must not have been reused */
+        CHECK( !scheduler_cancelled() );
+        scheduler_testcancel();
+}
+
+static void _scope_child_(void* arg) {
+        UNUSED(arg);
+        _spawn_(_scope_grandchild_, NULL);
+}
+
+static void _scope_parent_(void* arg) {
+        struct scheduler_group* group;
+        void* p[32];
+        size_t i;
+
+        UNUSED(arg);
+        if (!(group = scheduler_group_open())) {
+                EXIT("scheduler_group_open()");
+        }
+        CHECK( !scheduler_group_spawn(group, _scope_child_, NULL) );
+        scheduler_group_close(group);
+        /* recycle anything the close freed with every bit set */
+        scheduler_lock(&_scope_lock_);
+        for (i=0; i<ARRAY_SIZE(p); ++i) {
+                if ((p[i] = malloc(16 + 8 * i))) {
+                        memset(p[i], 0xff, 16 + 8 * i);
+                }
+        }
+        scheduler_unlock(&_scope_lock_);
+        __atomic_store_n(&_scope_closed_, 1, __ATOMIC_SEQ_CST);
+        scheduler_yield();
+        scheduler_lock(&_scope_lock_);
+        for (i=0; i<ARRAY_SIZE(p); ++i) {
+                free(p[i]);
+        }
+        scheduler_unlock(&_scope_lock_);
+}
+
+/**
+ * a grandchild inherits its group's scope and may outlive the close of
+ * the group, which must keep the scope until the grandchild terminates
+ */
+static int _test_scope_(void) {
+        _scope_closed_ = 0;
+        _init_(1, 1000, SCHEDULER_RR);
+        _spawn_(_scope_parent_, NULL);
+        scheduler_execute();
+        return 0;
+}
+
+/* cancel --------------------------------------------------------------- */
+
+static struct scheduler_mutex* _cancel_mutex_;
+static struct scheduler_cond* _cancel_cond_;
+static struct scheduler_chan* _cancel_chan_;
+static int _cancel_parked_;
+
+static void _cancel_cond_waiter_(void* arg) {
+        UNUSED(arg);
+        scheduler_mutex_lock(_cancel_mutex_);
+        __atomic_add_fetch(&_cancel_parked_, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+                scheduler_cond_wait(_cancel_cond_, _cancel_mutex_);
+        }
+}
+
+static void _cancel_chan_waiter_(void* arg) {
+        void* value;
+
+        UNUSED(arg);
+        __atomic_add_fetch(&_cancel_parked_, 1, __ATOMIC_SEQ_CST);
+        scheduler_chan_recv(_cancel_chan_, &value);
+        CHECK( 0 );
+}
+
+static void _cancel_nested_(void* arg) {
+        struct scheduler_group* group;
+
+        UNUSED(arg);
+        if (!(group = scheduler_group_open())) {
+                EXIT("scheduler_group_open()");
+        }
+        CHECK( !scheduler_group_spawn(group, _cancel_chan_waiter_, NULL) );
+        scheduler_group_close(group);
+}
+
+static void _cancel_parent_(void* arg) {
+        struct scheduler_group* group;
+        void* result;
+        int cancelled;
+
+        UNUSED(arg);
+        if (!(group = scheduler_group_open())) {
+                EXIT("scheduler_group_open()");
+        }
+        CHECK( !scheduler_group_spawn(group, _cancel_cond_waiter_, NULL) );
+        CHECK( !scheduler_group_spawn(group, _cancel_nested_, NULL) );
+        while (2 > __atomic_load_n(&_cancel_parked_, __ATOMIC_SEQ_CST)) {
+                scheduler_yield();
+        }
+        scheduler_yield();
+        scheduler_group_cancel(group);
+        cancelled = 0;
+        while (scheduler_group_wait(group, &result)) {
+                cancelled += (SCHEDULER_CANCELED == result);
+        }
+        CHECK( 1 <= cancelled );
+        scheduler_group_close(group);
+}
+
+/**
+ * cancelling a group wakes its children parked on a condition, and the
+ * grandchildren parked on a channel in a group nested in it, so closing
+ * the group returns
+ */
+static int _test_cancel_(void) {
+        _cancel_parked_ = 0;
+        if (!(_cancel_mutex_ = scheduler_mutex_open()) ||
+            !(_cancel_cond_ = scheduler_cond_open()) ||
+            !(_cancel_chan_ = scheduler_chan_open(0))) {
+                EXIT("out of memory");
+        }
+        _init_(2, 1000, SCHEDULER_RR);
+        _spawn_(_cancel_parent_, NULL);
+        scheduler_execute();
+        scheduler_chan_close(_cancel_chan_);
+        scheduler_cond_close(_cancel_cond_);
+        scheduler_mutex_close(_cancel_mutex_);
+        return 0;
+}
+
+/* then ----------------------------------------------------------------- */
+
+static void _then_setter_(void* arg) {
+        scheduler_sleep(1000);
+        CHECK( !scheduler_future_set((struct scheduler_future*)arg, (void*)1) );
+}
+
+static void* _then_next_(void* value, void* arg) {
+        UNUSED(arg);
+        return (void*)((size_t)value + 1);
+}
+
+static void _then_main_(void* arg) {
+        struct scheduler_future* future;
+        struct scheduler_future* next;
+
+        UNUSED(arg);
+        if (!(future = scheduler_future_open()) ||
+            !(next = scheduler_future_then(future, _then_next_, NULL))) {
+                EXIT("out of memory");
+        }
+        _spawn_(_then_setter_, future);
+        scheduler_future_close(future);
+        CHECK( (void*)2 == scheduler_future_get(next) );
+        scheduler_future_close(next);
+}
+
+/**
+ * a future closed while a continuation is attached stays alive until the
+ * continuation has run, for a setter that borrowed it
+ */
+static int _test_then_(void) {
+        _init_(1, 1000, SCHEDULER_RR);
+        _spawn_(_then_main_, NULL);
+        scheduler_execute();
+        return 0;
+}
+
+/* fd ------------------------------------------------------------------- */
+
+#define FD_BYTES (4 * 1024 * 1024)
+
+static int _fd_[2];
+static size_t _fd_read_;
+
+static void _fd_reader_(void* arg) {
+        char c;
+
+        UNUSED(arg);
+        CHECK( 1 == scheduler_read(_fd_[0], &c, 1) );
+        _fd_read_ = 1;
+}
+
+static void _fd_writer_(void* arg) {
+        static char buf[4096];
+        size_t n;
+        ssize_t r;
+
+        UNUSED(arg);
+        for (n=0; n<FD_BYTES; n+=(size_t)r) {
+                if (0 >= (r = scheduler_write(_fd_[0], buf, sizeof (buf)))) {
+                        CHECK( 0 );
+                        return;
+                }
+        }
+}
+
+static void _fd_peer_(void* arg) {
+        static char buf[4096];
+        size_t n;
+        ssize_t r;
+
+        UNUSED(arg);
+        for (n=0; n<FD_BYTES; n+=(size_t)r) {
+                if (0 >= (r = scheduler_read(_fd_[1], buf, sizeof (buf)))) {
+                        CHECK( 0 );
+                        return;
+                }
+        }
+        CHECK( 1 == scheduler_write(_fd_[1], buf, 1) );
+}
+
+/**
+ * a reader and a writer parked on the same fd of one worker are both
+ * resumed, the writer's registration does not replace the reader's
+ */
+static int _test_fd_(void) {
+        _fd_read_ = 0;
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, _fd_)) {
+                EXIT("socketpair()");
+        }
+        _init_(1, 1000, SCHEDULER_RR);
+        _spawn_(_fd_reader_, NULL);
+        _spawn_(_fd_writer_, NULL);
+        _spawn_(_fd_peer_, NULL);
+        scheduler_execute();
+        CHECK( _fd_read_ );
+        close(_fd_[0]);
+        close(_fd_[1]);
+        return 0;
+}
+
+static const struct {
+        const char* name;
+        int (*fnc)(void);
+} TESTS[] = {
+        { "offload", _test_offload_ },
+        { "overrun", _test_overrun_ },
+        { "slice", _test_slice_ },
+        { "wake", _test_wake_ },
+        { "scope", _test_scope_ },
+        { "cancel", _test_cancel_ },
+        { "then", _test_then_ },
+        { "fd", _test_fd_ }
+};
+
+int main(int argc, char *argv[]) {
+        int failed;
+        size_t i;
+
+        failed = 0;
+        for (i=0; i<ARRAY_SIZE(TESTS); ++i) {
+                if ((1 < argc) && strcmp(argv[1], TESTS[i].name)) {
+                        continue;
+                }
+                _failed_ = 0;
+                if (TESTS[i].fnc() || _failed_) {
+                        printf("FAIL %s\n", TESTS[i].name);
+                        failed++;
+                } else {
+                        printf("ok   %s\n", TESTS[i].name);
+                }
+        }
+        return failed ? -1 : 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * trace.c
+ */
+
+#include "trace.h"
+
+struct event {
+        uint64_t begin;
+        uint64_t end;
+        uint64_t id;
+        const char* what;
+};
+
+/**
+ * head counts the intervals ever recorded; the writer fills the slot
+ * before publishing the new head, so a reader sees complete slots for all
+ * but the ones being overwritten under it
+ */
+struct ring {
+        uint64_t head;
+        struct event* event;
+};
+
+struct trace {
+        size_t n;
+        uint64_t mask;
+        struct ring* ring;
+};
+
+struct trace *trace_open(size_t producers, size_t capacity) {
+        struct trace* trace;
+        uint64_t size;
+        size_t i;
+
+        size = 2;
+        while (size < capacity) {
+                size *= 2;
+        }
+        if (!(trace = (struct trace*)malloc(sizeof (struct trace)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
+        trace->n = producers;
+        trace->mask = size - 1;
+        if (!(trace->ring = (struct ring*)calloc(producers, sizeof (struct ring)))) {
+                TRACE("out of memory");
+                free(trace);
+                return NULL;
+        }
+        for (i=0; i<producers; ++i) {
+                if (!(trace->ring[i].event = (struct event*)malloc(size * sizeof (struct event)))) {
+                        TRACE("out of memory");
+                        trace_close(trace);
+                        return NULL;
+                }
+        }
+        return trace;
+}
+
+void trace_close(struct trace *trace) {
+        size_t i;
+
+        if (trace) {
+                for (i=0; i<trace->n; ++i) {
+                        FREE(trace->ring[i].event);
+                }
+                FREE(trace->ring);
+                FREE(trace);
+        }
+}
+
+void trace_record(struct trace *trace,
+                  size_t producer,
+                  uint64_t begin,
+                  uint64_t end,
+                  uint64_t id,
+                  const char *what) {
+        struct event* e;
+        struct ring* ring;
+        uint64_t head;
+
+        ring = &trace->ring[producer];
+        head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        e = &ring->event[head & trace->mask];
+        e->begin = begin;
+        e->end = end;
+        e->id = id;
+        e->what = what;
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int trace_dump(const struct trace *trace, const char *pathname) {
+        const struct event* e;
+        const struct ring* ring;
+        uint64_t origin;
+        uint64_t head;
+        uint64_t k;
+        size_t i;
+        FILE* file;
+        int first;
+
+        if (!(file = fopen(pathname, "w"))) {
+                TRACE("fopen()");
+                return -1;
+        }
+
+        /* timestamps are relative to the earliest interval kept */
+        origin = UINT64_MAX;
+        for (i=0; i<trace->n; ++i) {
+                ring = &trace->ring[i];
+                head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+                k = (head > trace->mask) ? (head - trace->mask - 1) : 0;
+                for (; k<head; ++k) {
+                        e = &ring->event[k & trace->mask];
+                        if (origin > e->begin) {
+                                origin = e->begin;
+                        }
+                }
+        }
+
+        first = 1;
+        fprintf(file, "{\"traceEvents\":[");
+        for (i=0; i<trace->n; ++i) {
+                ring = &trace->ring[i];
+                fprintf(file,
+                        "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"tid\":%lu,\"args\":{\"name\":\"worker %lu\"}}",
+                        first ? "" : ",",
+                        (unsigned long)i,
+                        (unsigned long)i);
+                first = 0;
+                head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+                k = (head > trace->mask) ? (head - trace->mask - 1) : 0;
+                for (; k<head; ++k) {
+                        e = &ring->event[k & trace->mask];
+                        fprintf(file,
+                                ",\n{\"name\":\"job %lu\",\"cat\":\"%s\",\"ph\":\"X\","
+                                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lu,"
+                                "\"args\":{\"out\":\"%s\"}}",
+                                (unsigned long)e->id,
+                                e->what,
+                                (double)(e->begin - origin) / 1e3,
+                                (double)(e->end - e->begin) / 1e3,
+                                (unsigned long)i,
+                                e->what);
+                }
+        }
+        fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+        if (fclose(file)) {
+                TRACE("fclose()");
+                return -1;
+        }
+        return 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * trace.h
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "system.h"
+
+struct trace;
+
+/**
+ * Creates a trace of time intervals, one ring buffer per producer. Each
+ * ring has a single writer and never blocks it: once full, the oldest
+ * interval is overwritten.
+ *
+ * producers: number of rings, one per writing thread
+ * capacity : intervals kept per ring, rounded up to a power of two
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct trace *trace_open(size_t producers, size_t capacity);
+
+/**
+ * Destroys a trace previously obtained by calling trace_open().
+ *
+ * Note: trace may be NULL
+ */
+
+void trace_close(struct trace *trace);
+
+/**
+ * Appends an interval to the ring of producer. Only that producer's
+ * thread may record into it.
+ *
+ * producer: the ring, below the producers given to trace_open()
+ * begin   : monotonic ns the interval began
+ * end     : monotonic ns the interval ended
+ * id      : what ran during the interval
+ * what    : a static string saying how the interval ended
+ */
+
+void trace_record(struct trace *trace,
+                  size_t producer,
+                  uint64_t begin,
+                  uint64_t end,
+                  uint64_t id,
+                  const char *what);
+
+/**
+ * Writes the intervals as Chrome trace-event JSON (chrome://tracing,
+ * Perfetto), one track per producer. Intervals recorded concurrently with
+ * the dump may come out torn.
+ *
+ * return: 0 on success, -1 on error
+ */
+
+int trace_dump(const struct trace *trace, const char *pathname);
+
+#endif /* _TRACE_H_ */
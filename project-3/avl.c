@@ -10,205 +10,239 @@
 #include "scm.h"
 #include "avl.h"
 
+/**
+ * the tree lives in the SCM region, which may be mapped at a different
+ * address every time it is opened; its links are therefore offsets into
+ * the region, 0 standing for NULL, turned into pointers with NODE()
+ */
+
+#define NODE(avl, off) ((struct node *)scm_pointer((avl)->scm, (off)))
+#define ITEM(avl, node) ((const char *)scm_pointer((avl)->scm, (node)->item))
+
 struct avl {
 	struct state {
 		uint64_t items;
 		uint64_t unique;
-		struct node {
-			int depth;
-			uint64_t count;
-			const char *item;
-			struct node *left;
-			struct node *right;
-		} *root;
+		uint64_t root;
 	} *state; /* SCM */
 	struct scm *scm;
 };
 
+struct node {
+	int depth;
+	uint64_t count;
+	uint64_t item;
+	uint64_t left;
+	uint64_t right;
+}; /* SCM */
+
 static int
-delta(const struct node *node)
+delta(const struct avl *avl, uint64_t node)
 {
-	return node ? node->depth : -1;
+	return node ? NODE(avl, node)->depth : -1;
 }
 
 static int
-balance(const struct node *node)
+balance(const struct avl *avl, uint64_t node)
 {
-	return delta(node->left) - delta(node->right);
+	return delta(avl, NODE(avl, node)->left) -
+		delta(avl, NODE(avl, node)->right);
 }
 
 static int
-depth(const struct node *a, const struct node *b)
+depth(const struct avl *avl, uint64_t a, uint64_t b)
 {
-	return (delta(a) > delta(b)) ? (delta(a) + 1) : (delta(b) + 1);
+	return (delta(avl, a) > delta(avl, b)) ?
+		(delta(avl, a) + 1) :
+		(delta(avl, b) + 1);
 }
 
-static struct node *
-rotate_right(struct node *node)
+static uint64_t
+rotate_right(const struct avl *avl, uint64_t node)
 {
-	struct node *root;
-
-	root = node->left;
-	node->left = root->right;
-	root->right = node;
-	node->depth = depth(node->left, node->right);
-	root->depth = depth(root->left, node);
+	struct node *n;
+	struct node *r;
+	uint64_t root;
+
+	n = NODE(avl, node);
+	root = n->left;
+	r = NODE(avl, root);
+	n->left = r->right;
+	r->right = node;
+	n->depth = depth(avl, n->left, n->right);
+	r->depth = depth(avl, r->left, node);
 	return root;
 }
 
-static struct node *
-rotate_left(struct node *node)
+static uint64_t
+rotate_left(const struct avl *avl, uint64_t node)
 {
-	struct node *root;
-
-	root = node->right;
-	node->right = root->left;
-	root->left = node;
-	node->depth = depth(node->left, node->right);
-	root->depth = depth(root->right, node);
+	struct node *n;
+	struct node *r;
+	uint64_t root;
+
+	n = NODE(avl, node);
+	root = n->right;
+	r = NODE(avl, root);
+	n->right = r->left;
+	r->left = node;
+	n->depth = depth(avl, n->left, n->right);
+	r->depth = depth(avl, r->right, node);
 	return root;
 }
 
-static struct node *
-rotate_left_right(struct node *node)
+static uint64_t
+rotate_left_right(const struct avl *avl, uint64_t node)
 {
-	node->left = rotate_left(node->left);
-	return rotate_right(node);
+	NODE(avl, node)->left = rotate_left(avl, NODE(avl, node)->left);
+	return rotate_right(avl, node);
 }
 
-static struct node *
-rotate_right_left(struct node *node)
+static uint64_t
+rotate_right_left(const struct avl *avl, uint64_t node)
 {
-	node->right = rotate_right(node->right);
-	return rotate_left(node);
+	NODE(avl, node)->right = rotate_right(avl, NODE(avl, node)->right);
+	return rotate_left(avl, node);
 }
 
-static struct node *
-update(struct avl *avl, struct node *root, const char *item)
+static uint64_t
+update(struct avl *avl, uint64_t root, const char *item)
 {
+	struct node *node;
+	char *s;
 	int d;
 
 	if (!root) {
-		if (!(root = scm_malloc(avl->scm, sizeof (struct node)))) {
+		if (!(node = scm_malloc(avl->scm, sizeof (struct node)))) {
 			TRACE(0);
-			return NULL;
+			return 0;
 		}
-		memset(root, 0, sizeof (struct node));
-		if (!(root->item = scm_strdup(avl->scm, item))) {
+		memset(node, 0, sizeof (struct node));
+		if (!(s = scm_strdup(avl->scm, item))) {
 			TRACE(0);
-			return NULL;
+			return 0;
 		}
-		++root->count;
+		node->item = scm_offset(avl->scm, s);
+		++node->count;
 		++avl->state->items;
 		++avl->state->unique;
-		return root;
+		return scm_offset(avl->scm, node);
 	}
-	if (!(d = strcmp(item, root->item))) {
-		++root->count;
+	node = NODE(avl, root);
+	if (!(d = strcmp(item, ITEM(avl, node)))) {
+		++node->count;
 		++avl->state->items;
 	}
 	else if (0 > d) {
-		root->left = update(avl, root->left, item);
-		if (1 < abs(balance(root))) {
-			if (0 > strcmp(item, root->left->item)) {
-				root = rotate_right(root);
+		node->left = update(avl, node->left, item);
+		if (1 < abs(balance(avl, root))) {
+			if (0 > strcmp(item, ITEM(avl, NODE(avl, node->left)))) {
+				root = rotate_right(avl, root);
 			}
 			else {
-				root = rotate_left_right(root);
+				root = rotate_left_right(avl, root);
 			}
 		}
 	}
 	else if (0 < d) {
-		root->right = update(avl, root->right, item);
-		if (1 < abs(balance(root))) {
-			if (0 < strcmp(item, root->right->item)) {
-				root = rotate_left(root);
+		node->right = update(avl, node->right, item);
+		if (1 < abs(balance(avl, root))) {
+			if (0 < strcmp(item, ITEM(avl, NODE(avl, node->right)))) {
+				root = rotate_left(avl, root);
 			}
 			else {
-				root = rotate_right_left(root);
+				root = rotate_right_left(avl, root);
 			}
 		}
 	}
-	root->depth = depth(root->left, root->right);
+	node = NODE(avl, root);
+	node->depth = depth(avl, node->left, node->right);
 	return root;
 }
 
 static void
-traverse(struct node *node, avl_fnc_t fnc, void *arg)
+traverse(const struct avl *avl, uint64_t node, avl_fnc_t fnc, void *arg)
 {
+	const struct node *n;
+
 	if (node) {
-		traverse(node->left, fnc, arg);
-		fnc(arg, node->item, node->count);
-		traverse(node->right, fnc, arg);
+		n = NODE(avl, node);
+		traverse(avl, n->left, fnc, arg);
+		fnc(arg, ITEM(avl, n), n->count);
+		traverse(avl, n->right, fnc, arg);
 	}
 }
 
-struct node* find_min(struct node* node) {
-        while(node->left) {
-                node = node->left;
+static struct node* find_min(const struct avl *avl, uint64_t node) {
+        while(NODE(avl, node)->left) {
+                node = NODE(avl, node)->left;
         }
-        return node;
+        return NODE(avl, node);
 }
 
-static struct node*
-delete(struct avl *avl, struct node *root, const char *item)
+static uint64_t
+delete(struct avl *avl, uint64_t root, const char *item)
 {
     int cmp;
     int balancefactor;
+    struct node *node;
     struct node *temp;
+    char *str;
     void *str_to_delete;
-    if (root == NULL)
+    if (root == 0)
          return root;
 
-     cmp = strcmp(item, root->item);
+     node = NODE(avl, root);
+     cmp = strcmp(item, ITEM(avl, node));
 
      if (cmp < 0)
-         root->left = delete(avl, root->left, item);
+         node->left = delete(avl, node->left, item);
      else if (cmp > 0)
-         root->right = delete(avl, root->right, item);
+         node->right = delete(avl, node->right, item);
      else {
-         if (root->count > 1) {
-             root->count--;
+         if (node->count > 1) {
+             node->count--;
          } else {
-             if (root->left == NULL) {
-                 struct node *temp = root->right;
-                 scm_free(avl->scm, (void *)root->item);
-                 scm_free(avl->scm, root);
+             if (node->left == 0) {
+                 uint64_t temp = node->right;
+                 scm_free(avl->scm, (void *)ITEM(avl, node));
+                 scm_free(avl->scm, node);
                  return temp;
-             } else if (root->right == NULL) {
-                 struct node *temp = root->left;
-                 scm_free(avl->scm, (void *)root->item);
-                 scm_free(avl->scm, root);
+             } else if (node->right == 0) {
+                 uint64_t temp = node->left;
+                 scm_free(avl->scm, (void *)ITEM(avl, node));
+                 scm_free(avl->scm, node);
                  return temp;
              }
 
-             temp = find_min(root->right);
-             str_to_delete = (void*)root->item;
-             root->item = scm_strdup(avl->scm, temp->item);
-             root->count = temp->count;
+             temp = find_min(avl, node->right);
+             str_to_delete = (void *)ITEM(avl, node);
+             str = scm_strdup(avl->scm, ITEM(avl, temp));
+             node->item = scm_offset(avl->scm, str);
+             node->count = temp->count;
              scm_free(avl->scm, str_to_delete);
              temp->count = 1;
-             root->right = delete(avl, root->right, temp->item);
+             node->right = delete(avl, node->right, str);
          }
      }
-     root->depth = depth(root->left,root->right);
-     balancefactor = balance(root);
+     node->depth = depth(avl, node->left,node->right);
+     balancefactor = balance(avl, root);
 
      if (balancefactor > 1) {
-         if (balance(root->left) >= 0)
-             return rotate_right(root);
+         if (balance(avl, node->left) >= 0)
+             return rotate_right(avl, root);
          else {
-             root->left = rotate_left(root->left);
-             return rotate_right(root);
+             node->left = rotate_left(avl, node->left);
+             return rotate_right(avl, root);
          }
      }
 
      if (balancefactor < -1) {
-         if (balance(root->right) <= 0)
-             return rotate_left(root);
+         if (balance(avl, node->right) <= 0)
+             return rotate_left(avl, root);
          else {
-             root->right = rotate_right(root->right);
-             return rotate_left(root);
+             node->right = rotate_right(avl, node->right);
+             return rotate_left(avl, root);
          }
      }
 
@@ -261,7 +295,7 @@ avl_close(struct avl *avl)
 int
 avl_insert(struct avl *avl, const char *item)
 {
-	struct node *root;
+	uint64_t root;
 
 	assert( avl );
 	assert( safe_strlen(item) );
@@ -298,43 +332,47 @@ uint64_t
 avl_exists(const struct avl *avl, const char *item)
 {
 	const struct node *node;
+	uint64_t off;
 	int d;
 
 	assert( avl );
 	assert( safe_strlen(item) );
 
-	node = avl->state->root;
-	while (node) {
-		if (!(d = strcmp(item, node->item))) {
+	off = avl->state->root;
+	while (off) {
+		node = NODE(avl, off);
+		if (!(d = strcmp(item, ITEM(avl, node)))) {
 			return node->count;
 		}
-		node = (0 > d) ? node->left : node->right;
+		off = (0 > d) ? node->left : node->right;
 	}
 	return 0;
 }
 
-void
-print(const struct node *node, int space)
+static void
+print(const struct avl *avl, uint64_t off, int space)
 {
+        const struct node *node;
         int i;
-        if (node == NULL)
+        if (off == 0)
                 return;
+        node = NODE(avl, off);
         space += 10;
-        print(node->right, space);
+        print(avl, node->right, space);
 
         printf("\n");
         for (i=0; i<space; i++)
                 printf(" ");
-        printf("%s(%ld)", node->item, node->count);
+        printf("%s(%ld)", ITEM(avl, node), node->count);
 
-        print(node->left, space);
+        print(avl, node->left, space);
         return;
 }
 
 void
 avl_print(const struct avl *avl)
 {
-        print(avl->state->root, 0);
+        print(avl, avl->state->root, 0);
         printf("\n");
 }
 
@@ -344,7 +382,7 @@ avl_traverse(const struct avl *avl, avl_fnc_t fnc, void *arg)
 	assert( avl );
 	assert( fnc );
 
-	traverse(avl->state->root, fnc, arg);
+	traverse(avl, avl->state->root, fnc, arg);
 }
 
 uint64_t
@@ -378,3 +416,11 @@ avl_scm_capacity(const struct avl *avl)
 
 	return scm_capacity(avl->scm);
 }
+
+double
+avl_scm_fragmentation(const struct avl *avl)
+{
+	assert( avl );
+
+	return scm_fragmentation(avl->scm);
+}
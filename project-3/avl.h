@@ -38,4 +38,6 @@ size_t avl_scm_utilized(const struct avl *avl);
 
 size_t avl_scm_capacity(const struct avl *avl);
 
+double avl_scm_fragmentation(const struct avl *avl);
+
 #endif /* _AVL_H_ */
@@ -109,11 +109,13 @@ info(struct avl *avl, const char *s)
 	       "  words    : %lu (unique)\n"
 	       "  utilized : %lu bytes\n"
 	       "  capacity : %lu bytes\n"
+	       "  fragment : %.1f%%\n"
 	       "\n",
 	       (unsigned long)avl_items(avl),
 	       (unsigned long)avl_unique(avl),
 	       (unsigned long)avl_scm_utilized(avl),
-	       (unsigned long)avl_scm_capacity(avl));
+	       (unsigned long)avl_scm_capacity(avl),
+	       100.0 * avl_scm_fragmentation(avl));
 	return 0;
 }
 
@@ -15,21 +15,67 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <stdbool.h>
+#include <signal.h>
 #include "scm.h"
 
-#define VM_START_ADDR 0x700000000000
+#define VM_RESERVE ((size_t)1 << 40) /* address space kept for growth */
 
 /**
- * defining size info id as INT_MAX-1 
- * when we see this id at the start of the file, then
- * it means that the size was stored from previous
- * execution of the process, and this much data is
- * currently stored in the file
+ * layout of the region:
+ *
+ *   struct head | block | block | ... | unused
+ *
+ * every block is a struct block header followed by its payload, which is
+ * what scm_malloc() hands out. Payload sizes are rounded up to ALIGN so
+ * that payloads stay 16-byte aligned. The first header word is a checksum
+ * of the block's offset, size and state (see block_tag()), which lets
+ * scm_free() vet a pointer by looking at its header alone.
+ *
+ * the free blocks are kept on per size class doubly linked lists whose
+ * heads live in struct head, so they persist with the data. A small class
+ * holds blocks of exactly one payload size (ALIGN apart, up to SMALL_MAX),
+ * a large class holds the payload sizes of one power of two. The links are
+ * offsets from the start of the region, 0 meaning none, kept in the first
+ * two words of the free block's payload.
+ *
+ * free blocks also repeat their size in the last word of the payload, a
+ * boundary tag, and the block after a free block has PREV_FREE set in its
+ * size word. scm_free() uses both to merge a block with free neighbours on
+ * either side in O(1), and scm_malloc() splits the tail off a block that
+ * is larger than needed. No two free blocks are ever adjacent and the last
+ * block is never free: it is given back to the unused space instead.
+ *
+ * the file is mapped at the start of a VM_RESERVE byte range reserved
+ * wherever the kernel finds room, so any number of regions can be open at
+ * once and nothing else mapped in the process is ever replaced. Since the
+ * region may land at a different address each time, everything stored in
+ * it refers to other parts of it by offset (see scm_pointer()). When the
+ * heap runs into the end of the file, the file is at least doubled with
+ * ftruncate() and the new part is mapped right after the old one, inside
+ * the reservation, so no address ever moves.
+ *
+ * scm_sync() tracks the pages written since the previous call by keeping
+ * the region read-only: the first write to a page faults, the SIGSEGV
+ * handler marks the page in the dirty bitmap of its region and makes it
+ * writable again. Only the dirty pages are flushed, one msync() per run of
+ * consecutive pages.
+ *
+ * the head carries a clean flag that is cleared while the region is open;
+ * if the process dies before scm_close() the lists are rebuilt by walking
+ * the blocks on the next scm_open().
  */
-#define SIZE_INFO_ID SIZE_MAX-1
-#define SIZE_INFO_BYTES 3*sizeof(size_t)
-#define ADDR_INFO_BYTES 2*sizeof(size_t)
+
+#define SCM_MAGIC 0x53434d3034394c53UL
+#define BLOCK_MAGIC 0x626c6f636b746167UL
+#define ALIGN 16
+#define SMALL_MAX 1024
+#define SMALL_BINS (SMALL_MAX / ALIGN)
+#define BINS (SMALL_BINS + 64)
+#define HEAD_BYTES ((sizeof (struct head) + ALIGN - 1) & ~((size_t)ALIGN - 1))
+#define BLOCK_BYTES (2 * sizeof (size_t))
+#define MIN_PAYLOAD (2 * ALIGN) /* links and boundary tag of a free block */
+#define PREV_FREE ((size_t)1)
+#define SIZE(b) ((b)->size & ~((size_t)ALIGN - 1))
 
 /**
  * Needs:
@@ -37,23 +83,262 @@
  *   S_ISREG()
  *   open()
  *   close()
- *   sbrk()
+ *   ftruncate()
  *   mmap()
+ *   mprotect()
  *   munmap()
  *   msync()
+ *   sigaction()
  */
 
+struct head {
+        size_t magic;
+        size_t clean; /* 1 once closed, the free lists can be trusted */
+        size_t used; /* bytes of blocks carved so far, headers included */
+        size_t user; /* payload bytes of the blocks in use */
+        size_t free; /* payload bytes of the free blocks */
+        size_t bins[BINS]; /* offset of the first free block of each class */
+};
+
+struct block {
+        size_t tag; /* block_tag() of the block in its current state */
+        size_t size; /* payload bytes, PREV_FREE in the low bits */
+        size_t next; /* free blocks only: free list links */
+        size_t prev;
+};
+
 struct scm {
         int fd;
         size_t size;
-        size_t used_bytes; /* total bytes used in scm region(includes metadata) */
-        size_t user_bytes; /* total bytes that is currently used by application */
-        size_t* size_info;
-        void *base_addr;
+        struct head* head;
+        void *base_addr; /* first block */
         void *mapped_addr;
+        uint64_t* bitmap; /* optional, see scm_bitmap() */
+        size_t bitmap_words;
+        size_t page;
+        uint64_t* dirty; /* pages written since scm_sync(), NULL until then */
+        size_t dirty_words;
+        struct scm* next; /* on tracked */
 };
 
-/* research the above Needed API and design accordingly */
+static struct scm* tracked; /* regions with dirty page tracking */
+static struct sigaction old_action; /* SIGSEGV action before scm_fault() */
+static int installed; /* scm_fault() installed, it stays for good */
+
+static size_t bin_of(size_t size) {
+        size_t i;
+
+        if (SMALL_MAX >= size) {
+                return size / ALIGN - 1;
+        }
+        i = 0;
+        while (size >>= 1) {
+                ++i;
+        }
+        return SMALL_BINS + i;
+}
+
+static struct block* block_at(const struct scm* scm, size_t off) {
+        return (struct block*)((char*)scm->mapped_addr + off);
+}
+
+static size_t block_off(const struct scm* scm, const struct block* block) {
+        return (size_t)((const char*)block - (const char*)scm->mapped_addr);
+}
+
+/**
+ * a checksum of where the block is, its size and whether it is in use; a
+ * stray pointer or a scribbled header is unlikely to carry the right one
+ */
+static size_t block_tag(const struct scm* scm, const struct block* block, int inuse) {
+        size_t tag;
+
+        tag = BLOCK_MAGIC ^ (block_off(scm, block) * 0x9e3779b97f4a7c15UL) ^ block->size;
+        return inuse ? tag : ~tag;
+}
+
+/**
+ * the block following block, or NULL if block is the last one
+ */
+static struct block* block_next(const struct scm* scm, const struct block* block) {
+        size_t off;
+
+        off = block_off(scm, block) + BLOCK_BYTES + SIZE(block);
+        return (HEAD_BYTES + scm->head->used > off) ? block_at(scm, off) : NULL;
+}
+
+/**
+ * sets or clears PREV_FREE of block, keeping its tag current
+ */
+static void block_prev_free(struct scm* scm, struct block* block, int free) {
+        int inuse;
+
+        if (block) {
+                inuse = (block_tag(scm, block, 1) == block->tag);
+                block->size = free ? (block->size | PREV_FREE) : SIZE(block);
+                block->tag = block_tag(scm, block, inuse);
+        }
+}
+
+static void bitmap_set(struct scm* scm, const struct block* block, int inuse) {
+        size_t i;
+
+        if (scm->bitmap) {
+                i = (block_off(scm, block) - HEAD_BYTES) / ALIGN;
+                if (inuse) {
+                        scm->bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+                } else {
+                        scm->bitmap[i / 64] &= ~((uint64_t)1 << (i % 64));
+                }
+        }
+}
+
+static int bitmap_get(const struct scm* scm, const struct block* block) {
+        size_t i;
+
+        if (scm->bitmap) {
+                i = (block_off(scm, block) - HEAD_BYTES) / ALIGN;
+                return (int)((scm->bitmap[i / 64] >> (i % 64)) & 1);
+        }
+        return 1;
+}
+
+static void bin_push(struct scm* scm, struct block* block) {
+        size_t i;
+
+        i = bin_of(SIZE(block));
+        block->tag = block_tag(scm, block, 0);
+        block->prev = 0;
+        block->next = scm->head->bins[i];
+        if (block->next) {
+                block_at(scm, block->next)->prev = block_off(scm, block);
+        }
+        scm->head->bins[i] = block_off(scm, block);
+        scm->head->free += SIZE(block);
+        *(size_t*)((char*)block + BLOCK_BYTES + SIZE(block) - sizeof (size_t)) = SIZE(block);
+}
+
+static void bin_remove(struct scm* scm, struct block* block) {
+        if (block->prev) {
+                block_at(scm, block->prev)->next = block->next;
+        } else {
+                scm->head->bins[bin_of(SIZE(block))] = block->next;
+        }
+        if (block->next) {
+                block_at(scm, block->next)->prev = block->prev;
+        }
+        scm->head->free -= SIZE(block);
+        block->tag = block_tag(scm, block, 1);
+}
+
+/**
+ * finds a free block with at least size payload bytes in O(1), never
+ * walking a list: the head of its own class if it fits, which it always
+ * does in an exact small class, else the head of the first non-empty
+ * larger class, where every block fits
+ */
+static struct block* bin_find(struct scm* scm, size_t size) {
+        struct block* block;
+        size_t i;
+
+        i = bin_of(size);
+        if (scm->head->bins[i]) {
+                block = block_at(scm, scm->head->bins[i]);
+                if (SIZE(block) >= size) {
+                        return block;
+                }
+        }
+        while (BINS > ++i) {
+                if (scm->head->bins[i]) {
+                        return block_at(scm, scm->head->bins[i]);
+                }
+        }
+        return NULL;
+}
+
+/**
+ * walks every block to recover the free lists, the byte counts and the
+ * PREV_FREE bits, merging neighbouring free blocks and cutting the heap
+ * short at the first block that does not fit
+ */
+static void heap_rebuild(struct scm* scm) {
+        struct head* head;
+        struct block* block;
+        struct block* prev;
+        size_t off;
+        size_t end;
+        size_t i;
+
+        head = scm->head;
+        for (i=0; i<BINS; ++i) {
+                head->bins[i] = 0;
+        }
+        head->user = 0;
+        head->free = 0;
+        end = HEAD_BYTES + head->used;
+        off = HEAD_BYTES;
+        prev = NULL; /* the free block right before off, if any */
+        while (off < end) {
+                block = block_at(scm, off);
+                if ((BLOCK_BYTES + SIZE(block) > end - off) ||
+                    !SIZE(block) ||
+                    ((block_tag(scm, block, 1) != block->tag) &&
+                     (block_tag(scm, block, 0) != block->tag))) {
+                        TRACE("corrupt block, heap truncated");
+                        break;
+                }
+                off += BLOCK_BYTES + SIZE(block);
+                if (block_tag(scm, block, 1) == block->tag) {
+                        block_prev_free(scm, block, NULL != prev);
+                        head->user += SIZE(block);
+                        prev = NULL;
+                } else if (prev) {
+                        prev->size += BLOCK_BYTES + SIZE(block);
+                } else {
+                        block->size = SIZE(block);
+                        prev = block;
+                }
+        }
+        head->used = off - HEAD_BYTES;
+        if (prev) {
+                head->used = block_off(scm, prev) - HEAD_BYTES;
+        }
+        for (off=HEAD_BYTES; off<HEAD_BYTES + head->used; off+=BLOCK_BYTES + SIZE(block)) {
+                block = block_at(scm, off);
+                if (block_tag(scm, block, 1) != block->tag) {
+                        bin_push(scm, block);
+                }
+        }
+}
+
+/**
+ * checks what a clean region claims before trusting its free lists
+ */
+static int heap_valid(const struct scm* scm) {
+        const struct head* head;
+        const struct block* block;
+        size_t i;
+
+        head = scm->head;
+        if ((HEAD_BYTES + head->used > scm->size) || (head->used % ALIGN)) {
+                return 0;
+        }
+        for (i=0; i<BINS; ++i) {
+                if (head->bins[i]) {
+                        if ((HEAD_BYTES > head->bins[i]) ||
+                            (HEAD_BYTES + head->used <= head->bins[i]) ||
+                            (head->bins[i] % ALIGN)) {
+                                return 0;
+                        }
+                        block = block_at(scm, head->bins[i]);
+                        if ((block_tag(scm, block, 0) != block->tag) ||
+                            (bin_of(SIZE(block)) != i)) {
+                                return 0;
+                        }
+                }
+        }
+        return 1;
+}
 
 struct scm *scm_open(const char* pathname, int truncate) {
         struct stat statbuf;
@@ -61,9 +346,16 @@ struct scm *scm_open(const char* pathname, int truncate) {
 
         assert(safe_strlen(pathname));
 
-        scm = (struct scm*)malloc(sizeof(struct scm));
+        if (!(scm = (struct scm*)malloc(sizeof(struct scm)))) {
+                TRACE("out of memory");
+                return NULL;
+        }
         scm->base_addr = NULL;
         scm->mapped_addr = NULL;
+        scm->bitmap = NULL;
+        scm->page = page_size();
+        scm->dirty = NULL;
+        scm->next = NULL;
 
         scm->fd = open(pathname, O_RDWR);
 
@@ -84,125 +376,271 @@ struct scm *scm_open(const char* pathname, int truncate) {
                 return NULL;
         }
 
-        scm->size = statbuf.st_size;
-        scm->used_bytes = 0;
+        /**
+         * a file too small for the head, or whose size is not a multiple
+         * of the page size, is extended; it can start out empty
+         */
+        scm->size = (statbuf.st_size + page_size() - 1) / page_size() * page_size();
+        if (HEAD_BYTES + BLOCK_BYTES + MIN_PAYLOAD > scm->size) {
+                scm->size = page_size();
+        }
+        if ((scm->size != (size_t)statbuf.st_size) && ftruncate(scm->fd, scm->size)) {
+                TRACE("cannot extend file");
+                close(scm->fd);
+                free(scm);
+                return NULL;
+        }
 
         /**
-         * scm has fd, size of the file in bytes 
-         * now push the program break by 'size' (size is in bytes)
-         * the whole memory will serve us as virtual memory that
-         * should be mapped to the file
+         * reserve address space for the region to grow into, then map the
+         * file over its start; MAP_FIXED only replaces our own reservation
          */
 
-        scm->mapped_addr = mmap((void*)VM_START_ADDR,
+        scm->mapped_addr = mmap(NULL,
+                                VM_RESERVE,
+                                PROT_NONE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1,
+                                0);
+
+        if (MAP_FAILED == scm->mapped_addr) {
+                TRACE("reserve failed");
+                close(scm->fd);
+                free(scm);
+                scm = NULL;
+                return NULL;
+        }
+
+        if ((scm->size > VM_RESERVE) ||
+            (MAP_FAILED == mmap(scm->mapped_addr,
                                 scm->size,
                                 PROT_EXEC | PROT_READ | PROT_WRITE,
                                 MAP_FIXED | MAP_SHARED,
                                 scm->fd,
-                                0);
-
-        if ((MAP_FAILED == scm->mapped_addr) || ((void*)VM_START_ADDR != scm->mapped_addr)) {
+                                0))) {
                 TRACE("map failed");
+                munmap(scm->mapped_addr, VM_RESERVE);
+                close(scm->fd);
                 free(scm);
                 scm = NULL;
                 return NULL;
         }
 
-        scm->base_addr = (void*)((char*)scm->mapped_addr + SIZE_INFO_BYTES);
+        scm->head = (struct head*)scm->mapped_addr;
+        scm->base_addr = (void*)((char*)scm->mapped_addr + HEAD_BYTES);
 
-        scm->size_info = (size_t*)scm->mapped_addr;
-        if ((SIZE_INFO_ID != scm->size_info[0]) || truncate) {
+        if ((SCM_MAGIC != scm->head->magic) || truncate) {
                 /* first invocation, or truncate is true
-                 * in this case, the size should be set to 0
-                 * and then complete region should be used
-                 * by the process
+                 * in this case, the heap and the free lists
+                 * start out empty and then complete region
+                 * should be used by the process
                  */
-                scm->size_info[0] = SIZE_INFO_ID;
-                scm->size_info[1] = 0;
-                scm->size_info[2] = 0;
+                memset(scm->head, 0, sizeof (struct head));
+                scm->head->magic = SCM_MAGIC;
+        } else if (!scm->head->clean || !heap_valid(scm)) {
+                heap_rebuild(scm);
         }
-        scm->used_bytes = scm->size_info[1];
-        scm->user_bytes = scm->size_info[2];
-
-        close(scm->fd);
+        scm->head->clean = 0;
 
         return scm;
 }
 
-void *scm_malloc(struct scm *scm, size_t n) {
-        size_t *addr_info;
-        void *addr;
-        void *base;
+static void dirty_mark(struct scm* scm, size_t first, size_t last) {
+        size_t i;
 
-        addr = base = scm_mbase(scm);
-        while (addr < (void*)((char*)base + scm->used_bytes)) {
-                addr_info = (size_t*)addr - 2;
-                if ((addr_info[0] == 0) && (addr_info[1] >= n)) {
-                        addr_info[0] = 1;
-                        return addr;
-                }
-                addr = (void*)((char*)addr + addr_info[1] + ADDR_INFO_BYTES);
+        for (i=first; i<last; ++i) {
+                scm->dirty[i / 64] |= (uint64_t)1 << (i % 64);
         }
+}
 
-        if ((scm->used_bytes + n + ADDR_INFO_BYTES) > scm->size) {
-                EXIT("not enough memory");
-                return NULL;
-        }
-        
-        addr_info = (size_t*)((char*)scm->base_addr + scm->used_bytes);
-        addr_info[0] = 1; /* memory is in use */
-        addr_info[1] = n;
+static void dirty_clear(struct scm* scm, size_t first, size_t last) {
+        size_t i;
 
-        scm->user_bytes += n;
-        scm->used_bytes += (n + ADDR_INFO_BYTES);
-        scm->size_info[1] = scm->used_bytes;
-        scm->size_info[2] = scm->user_bytes;
-        
-        addr = (void*)((char*)addr_info + ADDR_INFO_BYTES);
-        return addr;
+        for (i=first; i<last; ++i) {
+                scm->dirty[i / 64] &= ~((uint64_t)1 << (i % 64));
+        }
 }
 
-void scm_close(struct scm *scm) {
-        scm->size_info[0] = SIZE_INFO_ID;
-        scm->size_info[1] = scm->used_bytes;
-        scm->size_info[2] = scm->user_bytes;
-        msync(scm->mapped_addr, scm->size, MS_SYNC);
-        munmap(scm->mapped_addr, scm->size);
-        free(scm);
+/**
+ * the SIGSEGV handler: a write to a write protected page of a tracked
+ * region marks the page dirty and unprotects it, anything else goes to the
+ * action installed before
+ */
+static void scm_fault(int sig, siginfo_t* info, void* context) {
+        struct scm* scm;
+        char* addr;
+        size_t i;
+
+        addr = (char*)info->si_addr;
+        for (scm=tracked; scm; scm=scm->next) {
+                if ((addr >= (char*)scm->mapped_addr) && (addr < (char*)scm->mapped_addr + scm->size)) {
+                        i = (size_t)(addr - (char*)scm->mapped_addr) / scm->page;
+                        scm->dirty[i / 64] |= (uint64_t)1 << (i % 64);
+                        if (!mprotect((char*)scm->mapped_addr + i * scm->page,
+                                      scm->page,
+                                      PROT_EXEC | PROT_READ | PROT_WRITE)) {
+                                return;
+                        }
+                        break;
+                }
+        }
+        if (SA_SIGINFO & old_action.sa_flags) {
+                old_action.sa_sigaction(sig, info, context);
+        } else if ((SIG_DFL != old_action.sa_handler) && (SIG_IGN != old_action.sa_handler)) {
+                old_action.sa_handler(sig);
+        } else {
+                /* returning faults again, this time with the default action */
+                signal(SIGSEGV, SIG_DFL);
+        }
 }
 
-char *scm_strdup(struct scm *scm, const char *s) {
-        char *temp;
-        size_t *addr_info;
+/**
+ * grows the file, and its mapping, to at least need bytes by doubling
+ */
+static int scm_grow(struct scm* scm, size_t need) {
+        uint64_t* bitmap;
+        size_t words;
+        size_t size;
+
+        if (need > VM_RESERVE) {
+                TRACE("not enough memory");
+                return -1;
+        }
+        size = scm->size;
+        while (size < need) {
+                size *= 2;
+        }
+        if (size > VM_RESERVE) {
+                size = VM_RESERVE;
+        }
+        if (ftruncate(scm->fd, size)) {
+                TRACE("cannot extend file");
+                return -1;
+        }
+        if (MAP_FAILED == mmap((char*)scm->mapped_addr + scm->size,
+                               size - scm->size,
+                               PROT_EXEC | PROT_READ | PROT_WRITE,
+                               MAP_FIXED | MAP_SHARED,
+                               scm->fd,
+                               scm->size)) {
+                TRACE("map failed");
+                if (ftruncate(scm->fd, scm->size)) {
+                        /* ignore, the mapped part is intact */
+                }
+                return -1;
+        }
+        if (scm->bitmap) {
+                words = size / ALIGN / 64 + 1;
+                if (!(bitmap = (uint64_t*)realloc(scm->bitmap, words * sizeof (uint64_t)))) {
+                        TRACE("out of memory");
+                        return -1;
+                }
+                memset(bitmap + scm->bitmap_words, 0, (words - scm->bitmap_words) * sizeof (uint64_t));
+                scm->bitmap = bitmap;
+                scm->bitmap_words = words;
+        }
+        if (scm->dirty) {
+                /* the new pages are not write protected, count them dirty */
+                words = size / scm->page / 64 + 1;
+                if (!(bitmap = (uint64_t*)realloc(scm->dirty, words * sizeof (uint64_t)))) {
+                        TRACE("out of memory");
+                        return -1;
+                }
+                memset(bitmap + scm->dirty_words, 0, (words - scm->dirty_words) * sizeof (uint64_t));
+                scm->dirty = bitmap;
+                scm->dirty_words = words;
+                dirty_mark(scm, scm->size / scm->page, size / scm->page);
+        }
+        scm->size = size;
+        return 0;
+}
 
-        addr_info = (size_t*)((char*)scm->base_addr + scm->used_bytes);
-        addr_info[0] = 1;
-        addr_info[1] = strlen(s) + 1;
+/**
+ * carves the tail off a block in use if it holds more than size payload
+ * bytes and the rest makes a block of its own
+ */
+static void block_split(struct scm* scm, struct block* block, size_t size) {
+        struct block* rest;
+        size_t n;
+
+        if (SIZE(block) - size >= BLOCK_BYTES + MIN_PAYLOAD) {
+                n = SIZE(block) - size - BLOCK_BYTES;
+                block->size = size | (block->size & PREV_FREE);
+                block->tag = block_tag(scm, block, 1);
+                rest = block_at(scm, block_off(scm, block) + BLOCK_BYTES + size);
+                rest->size = n;
+                bin_push(scm, rest);
+        } else {
+                block_prev_free(scm, block_next(scm, block), 0);
+        }
+}
 
-        temp =  (char*)addr_info + ADDR_INFO_BYTES;
-        strcpy(temp, s);
+void *scm_malloc(struct scm *scm, size_t n) {
+        struct block* block;
+        size_t size;
 
-        scm->user_bytes += addr_info[1];
-        scm->used_bytes += (addr_info[1] + ADDR_INFO_BYTES);
-        scm->size_info[1] = scm->used_bytes;
-        scm->size_info[2] = scm->user_bytes;
+        size = (n + ALIGN - 1) & ~((size_t)ALIGN - 1);
+        if ((size < n) || (size > VM_RESERVE)) {
+                TRACE("size overflow");
+                return NULL;
+        }
+        if (MIN_PAYLOAD > size) {
+                size = MIN_PAYLOAD;
+        }
 
-        return temp;
+        /**
+         * a free block that fits, split down to size, else fresh space at
+         * the top
+         */
+        if ((block = bin_find(scm, size))) {
+                bin_remove(scm, block);
+                block_split(scm, block, size);
+        } else {
+                if (((HEAD_BYTES + scm->head->used + BLOCK_BYTES + size) > scm->size) &&
+                    scm_grow(scm, HEAD_BYTES + scm->head->used + BLOCK_BYTES + size)) {
+                        TRACE(0);
+                        return NULL;
+                }
+                block = block_at(scm, HEAD_BYTES + scm->head->used);
+                block->size = size;
+                block->tag = block_tag(scm, block, 1);
+                scm->head->used += BLOCK_BYTES + size;
+        }
+        bitmap_set(scm, block, 1);
+        scm->head->user += SIZE(block);
+        return (char*)block + BLOCK_BYTES;
 }
 
-bool scm_allocated_addr(struct scm* scm, void *p) {
-        void* addr;
-        void* base;
+void scm_close(struct scm *scm) {
+        struct scm** link;
 
-        addr = base = scm_mbase(scm);
-        while (addr < (void*)((char*)base + scm->used_bytes)) {
-                if (addr == p) {
-                        return true;
+        scm->head->clean = 1;
+        if (scm->dirty) {
+                scm_sync(scm);
+                for (link=&tracked; *link!=scm; link=&(*link)->next) {
                 }
+                *link = scm->next;
+                free(scm->dirty);
+        } else {
+                msync(scm->mapped_addr, scm->size, MS_SYNC);
+        }
+        munmap(scm->mapped_addr, VM_RESERVE);
+        close(scm->fd);
+        free(scm->bitmap);
+        free(scm);
+}
 
-                addr = (void*)((char*)addr + ((size_t*)addr-2)[1] + ADDR_INFO_BYTES);
+char *scm_strdup(struct scm *scm, const char *s) {
+        char *temp;
+        size_t n;
+
+        n = strlen(s) + 1;
+        if (!(temp = (char*)scm_malloc(scm, n))) {
+                TRACE(0);
+                return NULL;
         }
-        return false;
+        memcpy(temp, s, n);
+        return temp;
 }
 
 /**
@@ -211,36 +649,176 @@ bool scm_allocated_addr(struct scm* scm, void *p) {
  * make use of this memory
  *
  * given address p, if it was allocated by previous
- * call to malloc, then (p - 2*sizeof(size_t))th address would
- * have the flag which represents whether the memory is active
- * or in use.. (p - sizeof(size_t))th address would have the
- * value of the size of the memory pointed by p
+ * call to malloc, then it is aligned, lies within
+ * the heap and the struct block just below p carries
+ * the tag of a block in use of that size; the block
+ * is merged with free neighbours and goes on the free
+ * list of its size class, or back to the top if it
+ * was the last one
  */
 void scm_free(struct scm *scm, void *p) {
-        size_t* addr_info;
+        struct block* block;
+        struct block* next;
+        struct block* prev;
+        size_t off;
+
+        if (!p) {
+                return;
+        }
 
-        if (!scm_allocated_addr(scm, p)) {
+        off = (size_t)p - (size_t)scm->mapped_addr;
+        if ((HEAD_BYTES + BLOCK_BYTES > off) ||
+            (HEAD_BYTES + scm->head->used <= off) ||
+            (off % ALIGN)) {
+                TRACE("invalid pointer");
+                return;
+        }
+        block = block_at(scm, off - BLOCK_BYTES);
+        if ((block_tag(scm, block, 1) != block->tag) || !bitmap_get(scm, block)) {
+                TRACE("invalid pointer or double free");
                 return;
         }
 
-        addr_info = (size_t*)p - 2;
-        addr_info[0] = 0; /* not in use */
-        scm->user_bytes -= addr_info[1];
-        scm->size_info[2] = scm->user_bytes;
+        bitmap_set(scm, block, 0);
+        scm->head->user -= SIZE(block);
+
+        /**
+         * merge with the free neighbours, the boundary tag leads back; a
+         * header merged away loses its tag, or freeing its old pointer
+         * again would pass for a block in use
+         */
+        if ((next = block_next(scm, block)) && (block_tag(scm, next, 0) == next->tag)) {
+                bin_remove(scm, next);
+                block->size += BLOCK_BYTES + SIZE(next);
+                next->tag = 0;
+        }
+        if (PREV_FREE & block->size) {
+                prev = block_at(scm, block_off(scm, block) - ((size_t*)block)[-1] - BLOCK_BYTES);
+                bin_remove(scm, prev);
+                prev->size += BLOCK_BYTES + SIZE(block);
+                block->tag = 0;
+                block = prev;
+        }
+
+        if (!(next = block_next(scm, block))) {
+                scm->head->used = block_off(scm, block) - HEAD_BYTES;
+                return;
+        }
+        bin_push(scm, block);
+        block_prev_free(scm, next, 1);
         return;
 }
 
+int scm_bitmap(struct scm *scm) {
+        struct block* block;
+        size_t off;
+        size_t end;
+
+        if (scm->bitmap) {
+                return 0;
+        }
+        scm->bitmap_words = scm->size / ALIGN / 64 + 1;
+        if (!(scm->bitmap = (uint64_t*)calloc(scm->bitmap_words, sizeof (uint64_t)))) {
+                TRACE("out of memory");
+                return -1;
+        }
+        end = HEAD_BYTES + scm->head->used;
+        for (off=HEAD_BYTES; off<end; off+=BLOCK_BYTES + SIZE(block)) {
+                block = block_at(scm, off);
+                if (block_tag(scm, block, 1) == block->tag) {
+                        bitmap_set(scm, block, 1);
+                }
+        }
+        return 0;
+}
+
+int scm_sync(struct scm *scm) {
+        struct sigaction action;
+        size_t pages;
+        size_t i;
+        size_t j;
+        int err;
+
+        pages = scm->size / scm->page;
+        if (!scm->dirty) {
+                /* first call: nothing is known, so every page is dirty */
+                if (!installed) {
+                        memset(&action, 0, sizeof (action));
+                        action.sa_sigaction = scm_fault;
+                        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+                        sigemptyset(&action.sa_mask);
+                        if (sigaction(SIGSEGV, &action, &old_action)) {
+                                TRACE("sigaction()");
+                                return -1;
+                        }
+                        installed = 1;
+                }
+                scm->dirty_words = pages / 64 + 1;
+                if (!(scm->dirty = (uint64_t*)calloc(scm->dirty_words, sizeof (uint64_t)))) {
+                        TRACE("out of memory");
+                        return -1;
+                }
+                dirty_mark(scm, 0, pages);
+                scm->next = tracked;
+                tracked = scm;
+        }
+
+        err = 0;
+        i = 0;
+        while (i < pages) {
+                if (!scm->dirty[i / 64]) {
+                        i = (i / 64 + 1) * 64;
+                        continue;
+                }
+                if (!(scm->dirty[i / 64] & ((uint64_t)1 << (i % 64)))) {
+                        ++i;
+                        continue;
+                }
+                j = i + 1;
+                while ((j < pages) && (scm->dirty[j / 64] & ((uint64_t)1 << (j % 64)))) {
+                        ++j;
+                }
+                if (msync((char*)scm->mapped_addr + i * scm->page, (j - i) * scm->page, MS_SYNC)) {
+                        /* keep the run dirty, the next call retries it */
+                        TRACE("msync()");
+                        err = -1;
+                } else {
+                        dirty_clear(scm, i, j);
+                }
+                i = j;
+        }
+
+        if (mprotect(scm->mapped_addr, scm->size, PROT_EXEC | PROT_READ)) {
+                TRACE("mprotect()");
+                dirty_mark(scm, 0, pages);
+                return -1;
+        }
+        return err;
+}
+
 size_t scm_utilized(const struct scm *scm) {
-        return scm->user_bytes;
+        return scm->head->user;
+}
+
+double scm_fragmentation(const struct scm *scm) {
+        if (!scm->head->used) {
+                return 0.0;
+        }
+        return (double)scm->head->free / (double)scm->head->used;
 }
 
 size_t scm_capacity(const struct scm *scm) {
         return scm->size;
 }
 
+uint64_t scm_offset(const struct scm *scm, const void *p) {
+        return p ? (uint64_t)((const char*)p - (const char*)scm->mapped_addr) : 0;
+}
+
+void *scm_pointer(const struct scm *scm, uint64_t offset) {
+        return offset ? (char*)scm->mapped_addr + offset : NULL;
+}
+
 void *scm_mbase(struct scm *scm) {
-        if (scm->used_bytes) {
-                return (void*)((size_t*)scm->base_addr + 2);
-        }
-        return scm->base_addr;
+        return (char*)scm->base_addr + BLOCK_BYTES;
 }
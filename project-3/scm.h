@@ -18,6 +18,14 @@ struct scm;
  * Initializes an SCM region using the file specified in pathname as the
  * backing device, opening the regsion for memory allocation activities.
  *
+ * The file may start out small, even empty; the region grows with it, the
+ * file being at least doubled whenever scm_malloc() runs out of room.
+ * Addresses within the region stay the same as it grows, but the region is
+ * mapped wherever there is room and may be at a different address the next
+ * time it is opened. Data kept in it must therefore link to other data in
+ * it with scm_offset() rather than with pointers. Any number of regions can
+ * be open at the same time.
+ *
  * pathname: the file pathname of the backing device
  * truncate: if non-zero, truncates the SCM region, clearning all data
  *
@@ -36,6 +44,27 @@ struct scm *scm_open(const char *pathname, int truncate);
 
 void scm_close(struct scm *scm);
 
+/**
+ * Flushes the pages of the SCM region written since the previous call to
+ * the backing file, so that progress survives a crash, at a cost that
+ * follows what changed rather than the size of the region. The first call
+ * flushes everything and turns on dirty page tracking for the region: its
+ * pages are write protected and a SIGSEGV handler notes the first write to
+ * each. scm_close() then also flushes only the dirty pages.
+ *
+ * Note: once tracking is on, system calls that write into the region, such
+ *       as read() into a buffer allocated with scm_malloc(), fail with
+ *       EFAULT instead of faulting; copy through a buffer of your own. The
+ *       region must not be written by other threads during scm_sync().
+ *
+ * scm: an opaque handle previously obtained by calling scm_open()
+ *
+ * return: 0 on success, otherwise error; pages that failed to flush stay
+ *         dirty and are flushed again by the next call
+ */
+
+int scm_sync(struct scm *scm);
+
 /**
  * Analogous to the standard C malloc function, but using SCM region.
  *
@@ -67,6 +96,20 @@ char *scm_strdup(struct scm *scm, const char *s);
 
 void scm_free(struct scm *scm, void *p);
 
+/**
+ * Turns on an allocation bitmap kept in memory next to the SCM region, one
+ * bit per 16 bytes marking the blocks in use. scm_free() always checks the
+ * header checksum of p; with the bitmap it also rejects addresses inside a
+ * payload whose bytes happen to look like a header. Turning it on walks the
+ * heap once.
+ *
+ * scm: an opaque handle previously obtained by calling scm_open()
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int scm_bitmap(struct scm *scm);
+
 /**
  * Returns the number of SCM bytes utilized thus far.
  *
@@ -78,7 +121,22 @@ void scm_free(struct scm *scm, void *p);
 size_t scm_utilized(const struct scm *scm);
 
 /**
- * Returns the number of SCM bytes available in total.
+ * Returns the external fragmentation of the SCM region: the fraction of the
+ * bytes taken up by blocks thus far that sits in free blocks. Free blocks
+ * are merged with their neighbours as they are freed and split when reused,
+ * so under steady churn the heap stays within a small multiple of the bytes
+ * utilized.
+ *
+ * scm: an opaque handle previously obtained by calling scm_open()
+ *
+ * return: a number between 0 and 1
+ */
+
+double scm_fragmentation(const struct scm *scm);
+
+/**
+ * Returns the number of SCM bytes available in total, i.e., the current size
+ * of the backing file, which grows on demand.
  *
  * scm: an opaque handle previously obtained by calling scm_open()
  *
@@ -99,4 +157,28 @@ size_t scm_capacity(const struct scm *scm);
 
 void *scm_mbase(struct scm *scm);
 
+/**
+ * Converts a pointer into the SCM region to its offset from the start of
+ * the region, which, unlike the pointer, stays valid when the region is
+ * opened again.
+ *
+ * scm: an opaque handle previously obtained by calling scm_open()
+ * p  : a pointer into the SCM region, or NULL
+ *
+ * return: the offset of p, 0 if p is NULL
+ */
+
+uint64_t scm_offset(const struct scm *scm, const void *p);
+
+/**
+ * Converts an offset obtained from scm_offset() back to a pointer.
+ *
+ * scm   : an opaque handle previously obtained by calling scm_open()
+ * offset: an offset into the SCM region, or 0
+ *
+ * return: the pointer at offset, NULL if offset is 0
+ */
+
+void *scm_pointer(const struct scm *scm, uint64_t offset);
+
 #endif /* _SCM_H_ */
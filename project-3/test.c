@@ -0,0 +1,152 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * test.c
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include "scm.h"
+
+/**
+ * Regression tests of the SCM allocator, each a function returning 0 when
+ * it passes:
+ *
+ *   make test && ./cs238-test [name]
+ *
+ * The regions are backed by scratch files next to the binary.
+ */
+
+#define PATHNAME_A "test-a.scm"
+#define PATHNAME_B "test-b.scm"
+
+static int
+create(const char *pathname)
+{
+	FILE *file;
+
+	if (!(file = fopen(pathname, "w"))) {
+		TRACE("fopen()");
+		return -1;
+	}
+	fclose(file);
+	return 0;
+}
+
+#define SEGV_EXIT 42
+
+static void
+on_segv(int signum)
+{
+	UNUSED(signum);
+
+	_exit(SEGV_EXIT);
+}
+
+/**
+ * after one tracked region was closed, tracking a second one must still
+ * hand a genuine segmentation fault to the handler installed before, not
+ * loop in the fault handler
+ */
+static int
+test_sync_segv(void)
+{
+	struct scm *scm;
+	char *p;
+	int status;
+	pid_t pid;
+
+	if (create(PATHNAME_A) || create(PATHNAME_B)) {
+		return -1;
+	}
+	if (0 > (pid = fork())) {
+		TRACE("fork()");
+		return -1;
+	}
+	if (!pid) {
+		alarm(5);
+		signal(SIGSEGV, on_segv);
+		if (!(scm = scm_open(PATHNAME_A, 1)) || scm_sync(scm)) {
+			_exit(1);
+		}
+		scm_close(scm);
+		if (!(scm = scm_open(PATHNAME_B, 1)) || scm_sync(scm)) {
+			_exit(1);
+		}
+		p = scm_malloc(scm, 64);
+		p[0] = 1; /* a tracked write still works */
+		*(volatile char *)NULL = 1;
+		_exit(0);
+	}
+	waitpid(pid, &status, 0);
+	file_delete(PATHNAME_A);
+	file_delete(PATHNAME_B);
+	return (WIFEXITED(status) && (SEGV_EXIT == WEXITSTATUS(status))) ? 0 : -1;
+}
+
+/**
+ * freeing a block that was merged into its free neighbour is a double
+ * free, which must neither drop the live blocks from the count nor hand
+ * out a live block again
+ */
+static int
+test_double_free(void)
+{
+	struct scm *scm;
+	char *a, *b, *c;
+	size_t utilized;
+	int err;
+
+	if (create(PATHNAME_A) || !(scm = scm_open(PATHNAME_A, 1))) {
+		return -1;
+	}
+	a = scm_malloc(scm, 64);
+	b = scm_malloc(scm, 64);
+	c = scm_malloc(scm, 64);
+	utilized = scm_utilized(scm);
+	scm_free(scm, a);
+	scm_free(scm, b);
+	scm_free(scm, b);
+	err = (!a || !b || !c);
+	err |= (utilized - 128 != scm_utilized(scm));
+	err |= (c == scm_malloc(scm, 64));
+	scm_close(scm);
+	file_delete(PATHNAME_A);
+	return err ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const struct {
+		const char *name;
+		int (*fnc)(void);
+	} TESTS[] = {
+		{ "sync_segv", test_sync_segv },
+		{ "double_free", test_double_free }
+	};
+	int failed;
+	uint64_t i;
+
+	failed = 0;
+	for (i=0; i<ARRAY_SIZE(TESTS); ++i) {
+		if ((1 < argc) && strcmp(argv[1], TESTS[i].name)) {
+			continue;
+		}
+		if (TESTS[i].fnc()) {
+			printf("FAIL %s\n", TESTS[i].name);
+			failed++;
+		}
+		else {
+			printf("ok   %s\n", TESTS[i].name);
+		}
+	}
+	return failed ? -1 : 0;
+}